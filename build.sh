@@ -33,6 +33,7 @@ $COMPILER \
   -fstack-protector-strong \
   -D_FORTIFY_SOURCE=2 \
   -Wno-unused-result \
+  -pthread \
   -I./include \
   -I./deps/arena/include \
   -I./deps/CString/include \
@@ -40,7 +41,9 @@ $COMPILER \
   -I./deps/yyjson/include \
   ./deps/arena/lib/arena.c \
   ./deps/CString/lib/cstring.c \
+  ./deps/CString/lib/strscan.c \
   ./deps/container/lib/cvector.c \
+  ./deps/container/lib/chashmap.c \
   ./deps/yyjson/src/yyjson.c \
   ./src/main.c \
   ./src/cli.c \
@@ -49,6 +52,20 @@ $COMPILER \
   ./src/package_manager.c \
   ./src/utils.c \
   ./src/project_handler.c \
+  ./src/job_pool.c \
+  ./src/process.c \
+  ./src/hash.c \
+  ./src/build_log.c \
+  ./src/stat_cache.c \
+  ./src/deps_log.c \
+  ./src/project_model.c \
+  ./src/path_table.c \
+  ./src/thread_pool.c \
+  ./src/compile_cache.c \
+  ./src/compress.c \
+  ./src/remote_cache.c \
+  ./src/launcher.c \
+  ./src/dep_store.c \
   -o myBuild
 
 echo "* Build successful! Executable created at ./myBuild"
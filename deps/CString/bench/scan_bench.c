@@ -0,0 +1,196 @@
+/*
+ * Throughput of the scanning kernels against the byte by byte loops they
+ * replace, on a generated multi-MB `.d` file and a newline separated path
+ * list. Not part of the regular build:
+ *
+ *   cc -O2 -Ideps/arena/include -Ideps/CString/include \
+ *      deps/CString/bench/scan_bench.c deps/CString/lib/strscan.c \
+ *      -o scan_bench && ./scan_bench [MB]
+ * */
+#include <cstring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ROUNDS 20
+
+static volatile size_t sink;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t naive_find_special(const char *ptr, size_t len, char a, char b) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)ptr[i];
+		if (c <= ' ' || c == (unsigned char)a || c == (unsigned char)b) {
+			break;
+		}
+	}
+	return i;
+}
+
+static size_t naive_skip_space(const char *ptr, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		char c = ptr[i];
+		if (c != ' ' && (c < '\t' || c > '\r')) {
+			break;
+		}
+	}
+	return i;
+}
+
+static void naive_to_upper(char *dst, const char *src, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		char c = src[i];
+		dst[i] = (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+	}
+}
+
+static int naive_casecmp(const char *a, const char *b, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		char ca = a[i], cb = b[i];
+		ca = (ca >= 'A' && ca <= 'Z') ? (char)(ca + 32) : ca;
+		cb = (cb >= 'A' && cb <= 'Z') ? (char)(cb + 32) : cb;
+		if (ca != cb) {
+			return (unsigned char)ca - (unsigned char)cb;
+		}
+	}
+	return 0;
+}
+
+/* Something shaped like `gcc -MMD` output: one target and a long list of
+ * header paths joined with " \\\n" */
+static char *make_dep_file(size_t size) {
+	static const char *dirs[] = {"/usr/include/", "/usr/lib/gcc/include/",
+								 "./deps/container/include/", "./include/"};
+	char *buf = (char *)malloc(size + 1);
+	size_t len = 0;
+	int n = 0;
+
+	len += snprintf(buf, size, "build/obj/main.o: src/main.c");
+	while (len + 128 < size) {
+		len += snprintf(buf + len, size - len, " \\\n  %sheader_%05d.h",
+						dirs[n % 4], n);
+		n++;
+	}
+	buf[len] = '\0';
+	return buf;
+}
+
+static char *make_path_list(size_t size) {
+	char *buf = (char *)malloc(size + 1);
+	size_t len = 0;
+	int n = 0;
+
+	while (len + 128 < size) {
+		len += snprintf(buf + len, size - len,
+						"src/Module_%d/SubDir/Source_File_%06d.c\n", n % 97, n);
+		n++;
+	}
+	buf[len] = '\0';
+	return buf;
+}
+
+/* Steps over the separators between tokens like `read_dep_file` does */
+static size_t skip_separators(const char *buf, size_t pos, size_t len) {
+	while (pos < len && (buf[pos] <= ' ' || buf[pos] == '\\')) {
+		pos++;
+	}
+	return pos;
+}
+
+/* Counts tokens the way `read_dep_file` walks them: separators are stepped
+ * over, the path in between is one scan */
+static size_t tokens_scalar(const char *buf, size_t len) {
+	size_t count = 0, pos = skip_separators(buf, 0, len);
+	while (pos < len) {
+		pos += naive_find_special(buf + pos, len - pos, '\\', '$');
+		pos = skip_separators(buf, pos, len);
+		count++;
+	}
+	return count;
+}
+
+static size_t tokens_simd(const char *buf, size_t len) {
+	size_t count = 0, pos = skip_separators(buf, 0, len);
+	while (pos < len) {
+		pos += scan_find_special(buf + pos, len - pos, '\\', '$');
+		pos = skip_separators(buf, pos, len);
+		count++;
+	}
+	return count;
+}
+
+static void report(const char *name, size_t bytes, double scalar, double simd) {
+	double mb = (double)bytes * ROUNDS / (1024.0 * 1024.0);
+	printf("%-22s %10.0f MB/s %10.0f MB/s %7.1fx\n", name, mb / scalar,
+		   mb / simd, scalar / simd);
+}
+
+#define TIME(var, expr)                                                        \
+	do {                                                                       \
+		double start_ = now();                                                 \
+		for (int r_ = 0; r_ < ROUNDS; r_++) {                                  \
+			sink += (size_t)(expr);                                            \
+		}                                                                      \
+		var = now() - start_;                                                  \
+	} while (0)
+
+int main(int argc, char **argv) {
+	size_t size = (argc > 1 ? (size_t)atoi(argv[1]) : 8) * 1024 * 1024;
+	char *dep = make_dep_file(size);
+	char *paths = make_path_list(size);
+	size_t dep_len = strlen(dep);
+	size_t paths_len = strlen(paths);
+	char *out = (char *)malloc(paths_len + 1);
+	char *upper = (char *)malloc(paths_len + 1);
+	char *blank = (char *)malloc(paths_len + 1);
+	double scalar, simd;
+
+	/* indentation heavy input, the worst case for trimming */
+	for (size_t i = 0; i < paths_len; i++) {
+		blank[i] = i % 8 == 7 ? '\t' : ' ';
+	}
+	blank[paths_len] = '\0';
+
+	naive_to_upper(upper, paths, paths_len);
+	if (tokens_scalar(dep, dep_len) != tokens_simd(dep, dep_len) ||
+		naive_casecmp(paths, upper, paths_len) != 0 ||
+		scan_casecmp(paths, upper, paths_len) != 0) {
+		fprintf(stderr, "Error encountered while checking the kernels\n");
+		return 1;
+	}
+
+	printf("kernels: %s, %zu KB dep file, %zu KB path list\n",
+		   scan_kernel_name(), dep_len / 1024, paths_len / 1024);
+	printf("%-22s %15s %15s %8s\n", "", "scalar", "dispatched", "speedup");
+
+	TIME(scalar, tokens_scalar(dep, dep_len));
+	TIME(simd, tokens_simd(dep, dep_len));
+	report(".d tokens", dep_len, scalar, simd);
+
+	TIME(scalar, naive_skip_space(blank, paths_len));
+	TIME(simd, scan_skip_space(blank, paths_len));
+	report("skip space", paths_len, scalar, simd);
+
+	TIME(scalar, (naive_to_upper(out, paths, paths_len), out[0]));
+	TIME(simd, (scan_to_upper(out, paths, paths_len), out[0]));
+	report("to upper", paths_len, scalar, simd);
+
+	TIME(scalar, naive_casecmp(paths, upper, paths_len));
+	TIME(simd, scan_casecmp(paths, upper, paths_len));
+	report("case-insensitive cmp", paths_len, scalar, simd);
+
+	free(dep);
+	free(paths);
+	free(out);
+	free(upper);
+	free(blank);
+	return 0;
+}
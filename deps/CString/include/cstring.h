@@ -20,10 +20,18 @@ void *m_align_realloc(void *ptr, size_t old_size, size_t new_size);
 /* Initiates an arena with the given capacity */
 Arena *arena_init(size_t capacity);
 
-/* Allocates a chunk on the arena, when the arena
- * gets full, it calls `arena_init` again internally to allocate more memory */
+/* Allocates a chunk on the arena with maximum memory alignment, when the
+ * current block gets full a new block twice as large is chained. The memory
+ * is not zeroed */
 void *arena_alloc(Arena *arena, size_t size);
 
+/* Same as `arena_alloc` but aligned to `alignment`, which must be a power of
+ * two */
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment);
+
+/* Same as `arena_alloc` but the memory is zeroed */
+void *arena_alloc_zeroed(Arena *arena, size_t size);
+
 /* Frees the arena and all the allocations done on it */
 void arena_free(Arena **arena);
 
@@ -31,6 +39,23 @@ void arena_free(Arena **arena);
 
 typedef struct String String;
 
+/* Non-owning view into a run of characters, not necessarily null
+ * terminated. Views never allocate, they stay valid as long as the
+ * characters they point to do */
+typedef struct {
+	const char *ptr;
+	size_t len;
+} StrView;
+
+/* Growable buffer for building a string piece by piece, the capacity doubles
+ * when it runs out so appending is amortized O(1). Lives on the stack or
+ * wherever the caller puts it, the buffer itself is on the heap */
+typedef struct {
+	char *buf;
+	size_t length;
+	size_t capacity;
+} StringBuilder;
+
 /* Creates a String object from c-string (char *) */
 String *string_from(Arena *arena, char *str);
 
@@ -65,4 +90,78 @@ char *string_upper(Arena *arena, String *str);
 /* Converts all upper-case characters in a string to lower-case*/
 char *string_lower(Arena *arena, String *str);
 
+/* Initiates a builder with room for `capacity` characters */
+void string_builder_init(StringBuilder *sb, size_t capacity);
+
+/* Makes sure `additional` more characters fit without growing again */
+void string_builder_reserve(StringBuilder *sb, size_t additional);
+
+/* Appends a c-string (char *) */
+void string_builder_append(StringBuilder *sb, const char *str);
+
+/* Appends a String object */
+void string_builder_append_string(StringBuilder *sb, String *str);
+
+/* Appends a single character */
+void string_builder_append_char(StringBuilder *sb, char c);
+
+/* Copies the built string onto the arena and frees the builder's buffer, the
+ * builder can be initiated again afterwards */
+String *string_builder_finish(Arena *arena, StringBuilder *sb);
+
+/* Frees the builder's buffer without producing a String */
+void string_builder_free(StringBuilder *sb);
+
+/* Creates a view over a c-string (char *) */
+StrView strview_from(const char *str);
+
+/* Creates a view over a String object */
+StrView strview_of(String *str);
+
+/* Takes the next `sep` separated token off the front of `rest` and stores it
+ * in `token`. Returns 0 once `rest` is exhausted, empty tokens between
+ * consecutive separators are returned as well */
+int strview_split_next(StrView *rest, char sep, StrView *token);
+
+/* Returns the view without leading and trailing white-spaces */
+StrView strview_trim(StrView view);
+
+/* Returns the index of the first `c` in the view, -1 when there is none */
+ptrdiff_t strview_find_char(StrView view, char c);
+
+/* Returns the index of the first occurrence of `needle`, -1 when there is
+ * none */
+ptrdiff_t strview_find(StrView haystack, StrView needle);
+
+/* Compares two views like strcmp */
+int strview_cmp(StrView a, StrView b);
+
+/* Returns 1 when the view holds exactly the c-string (char *) */
+int strview_eq_cstr(StrView view, const char *str);
+
+/* Copies the viewed characters into a new String object */
+String *string_from_view(Arena *arena, StrView view);
+
+/* Returns the index of the first byte that is a space or control character
+ * (<= ' ') or equal to `a` or `b`, `len` when there is none. SSE2/AVX2
+ * accelerated, picked at runtime */
+size_t scan_find_special(const char *ptr, size_t len, char a, char b);
+
+/* Returns the number of leading white-spaces */
+size_t scan_skip_space(const char *ptr, size_t len);
+
+/* Writes `len` characters of `src` to `dst` with ASCII letters converted to
+ * upper-case, `dst` may be `src` */
+void scan_to_upper(char *dst, const char *src, size_t len);
+
+/* Same as `scan_to_upper` but converts to lower-case */
+void scan_to_lower(char *dst, const char *src, size_t len);
+
+/* Compares `len` characters ignoring ASCII case, like strncasecmp without
+ * stopping at '\0' */
+int scan_casecmp(const char *a, const char *b, size_t len);
+
+/* Name of the kernels picked for this CPU: "avx2", "sse2" or "scalar" */
+const char *scan_kernel_name(void);
+
 #endif // CSTRING_H
@@ -10,22 +10,18 @@ struct String {
 };
 
 String *string_from(Arena *arena, char *str) {
-	int strlen;
+	size_t len;
 	String *st;
 	char *new_str;
 
-	strlen = 0;
+	len = strlen(str);
 	st = (String *)arena_alloc(arena, sizeof(String));
-	while (str[strlen] != '\0') {
-		strlen++;
-	}
-	new_str = (char *)arena_alloc(arena, strlen + 1); // +1 for null terminator
-	memcpy(new_str, str, strlen);
-
-	new_str[strlen] = '\0';
+	/* +1 for null terminator */
+	new_str = (char *)arena_alloc_aligned(arena, len + 1, 1);
+	memcpy(new_str, str, len + 1);
 
 	st->str = new_str;
-	st->length = strlen;
+	st->length = len;
 
 	return st;
 }
@@ -36,7 +32,7 @@ String *string_clone(Arena *arena, String *str) {
 
 	st = (String *)arena_alloc(arena, sizeof(String));
 
-	new_str = (char *)arena_alloc(arena, str->length + 1);
+	new_str = (char *)arena_alloc_aligned(arena, str->length + 1, 1);
 
 	memcpy(new_str, str->str, str->length);
 	new_str[str->length] = '\0';
@@ -59,7 +55,7 @@ String *string_concat(Arena *arena, int n, ...) {
 	}
 	va_end(args);
 
-	char *buf = arena_alloc(arena, length + 1);
+	char *buf = arena_alloc_aligned(arena, length + 1, 1);
 
 	char *p = buf;
 	va_start(args, n);
@@ -90,14 +86,14 @@ String *string_sub(Arena *arena, String *str, int begin, int end) {
 	if (begin < end && begin >= 0 && begin < str->length &&
 		end <= str->length) {
 		substring_length = (end - begin);
-		new_str = (char *)arena_alloc(arena, substring_length + 1);
+		new_str = (char *)arena_alloc_aligned(arena, substring_length + 1, 1);
 		memcpy(new_str, str->str + begin, substring_length);
 
 		new_str[substring_length] = '\0';
 		st->str = new_str;
 		st->length = substring_length;
 	} else {
-		new_str = (char *)arena_alloc(arena, 1);
+		new_str = (char *)arena_alloc_aligned(arena, 1, 1);
 		new_str[0] = '\0';
 		st->str = new_str;
 		st->length = 0;
@@ -120,7 +116,7 @@ String *string_concat_cstr(Arena *arena, int n, ...) {
 	}
 	va_end(args);
 
-	char *buf = arena_alloc(arena, length + 1);
+	char *buf = arena_alloc_aligned(arena, length + 1, 1);
 
 	char *p = buf;
 	va_start(args, n);
@@ -139,6 +135,11 @@ String *string_concat_cstr(Arena *arena, int n, ...) {
 	return s;
 }
 
+static int is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+		   c == '\f';
+}
+
 String *string_trim(Arena *arena, String *str) {
 	String *st;
 	char *new_str;
@@ -152,15 +153,14 @@ String *string_trim(Arena *arena, String *str) {
 
 	st = (String *)arena_alloc(arena, sizeof(String));
 
-	while (*(str->str + start) == ' ') {
-		start++;
-	}
-	while (end > start && *(str->str + end) == ' ') {
+	start = (int)scan_skip_space(str->str, str->length);
+	while (end > start && is_space(*(str->str + end))) {
 		end--;
 	}
 	len = (end - start) + 1;
-	new_str = (char *)arena_alloc(arena, len + 1);
+	new_str = (char *)arena_alloc_aligned(arena, len + 1, 1);
 	memcpy(new_str, str->str + start, len);
+	new_str[len] = '\0';
 
 	st->str = new_str;
 	st->length = len;
@@ -230,42 +230,206 @@ String *string_get(Arena *arena) {
 }
 
 char *string_upper(Arena *arena, String *str) {
-	size_t i;
 	if (!arena || !str || !str->str)
 		return NULL;
 
-	char *out = arena_alloc(arena, str->length + 1);
+	char *out = arena_alloc_aligned(arena, str->length + 1, 1);
 	if (!out)
 		return NULL;
 
-	for (i = 0; i < str->length; i++) {
-		char c = str->str[i];
-		if (c >= 'a' && c <= 'z') {
-			c = c - ('a' - 'A');
-		}
-		out[i] = c;
-	}
+	scan_to_upper(out, str->str, str->length);
 	out[str->length] = '\0';
 	return out;
 }
 
 char *string_lower(Arena *arena, String *str) {
-	size_t i;
 	if (!arena || !str || !str->str)
 		return NULL;
 
-	char *out = arena_alloc(arena, str->length + 1);
+	char *out = arena_alloc_aligned(arena, str->length + 1, 1);
 
 	if (!out)
 		return NULL;
 
-	for (i = 0; i < str->length; i++) {
-		char c = str->str[i];
-		if (c >= 'A' && c <= 'Z') {
-			c = c + ('a' - 'A');
-		}
-		out[i] = c;
-	}
+	scan_to_lower(out, str->str, str->length);
 	out[str->length] = '\0';
 	return out;
 }
+
+void string_builder_init(StringBuilder *sb, size_t capacity) {
+	sb->length = 0;
+	sb->capacity = capacity > 16 ? capacity : 16;
+	sb->buf = (char *)malloc(sb->capacity);
+	if (sb->buf == NULL) {
+		fprintf(stderr, "Fatal: Failed to allocate string builder");
+		abort();
+	}
+	sb->buf[0] = '\0';
+}
+
+void string_builder_reserve(StringBuilder *sb, size_t additional) {
+	size_t needed;
+	size_t capacity;
+	char *temp;
+
+	/* +1 for null terminator */
+	needed = sb->length + additional + 1;
+	if (needed <= sb->capacity) {
+		return;
+	}
+
+	capacity = sb->capacity;
+	while (capacity < needed) {
+		capacity *= 2;
+	}
+	temp = (char *)realloc(sb->buf, capacity);
+	if (temp == NULL) {
+		fprintf(stderr, "Fatal: Failed to grow string builder");
+		abort();
+	}
+	sb->buf = temp;
+	sb->capacity = capacity;
+}
+
+static void string_builder_append_n(StringBuilder *sb, const char *str,
+									size_t len) {
+	string_builder_reserve(sb, len);
+	memcpy(sb->buf + sb->length, str, len);
+	sb->length += len;
+	sb->buf[sb->length] = '\0';
+}
+
+void string_builder_append(StringBuilder *sb, const char *str) {
+	string_builder_append_n(sb, str, strlen(str));
+}
+
+void string_builder_append_string(StringBuilder *sb, String *str) {
+	string_builder_append_n(sb, str->str, str->length);
+}
+
+void string_builder_append_char(StringBuilder *sb, char c) {
+	string_builder_append_n(sb, &c, 1);
+}
+
+String *string_builder_finish(Arena *arena, StringBuilder *sb) {
+	String *st;
+	char *new_str;
+
+	st = (String *)arena_alloc(arena, sizeof(String));
+	new_str = (char *)arena_alloc_aligned(arena, sb->length + 1, 1);
+	memcpy(new_str, sb->buf, sb->length + 1);
+
+	st->str = new_str;
+	st->length = sb->length;
+
+	string_builder_free(sb);
+	return st;
+}
+
+void string_builder_free(StringBuilder *sb) {
+	free(sb->buf);
+	sb->buf = NULL;
+	sb->length = 0;
+	sb->capacity = 0;
+}
+
+StrView strview_from(const char *str) {
+	StrView view;
+	view.ptr = str;
+	view.len = strlen(str);
+	return view;
+}
+
+StrView strview_of(String *str) {
+	StrView view;
+	view.ptr = str->str;
+	view.len = str->length;
+	return view;
+}
+
+int strview_split_next(StrView *rest, char sep, StrView *token) {
+	const char *end;
+
+	if (rest->ptr == NULL) {
+		return 0;
+	}
+
+	end = (const char *)memchr(rest->ptr, sep, rest->len);
+	token->ptr = rest->ptr;
+	if (end == NULL) {
+		/* last token, mark the view as exhausted */
+		token->len = rest->len;
+		rest->ptr = NULL;
+		rest->len = 0;
+	} else {
+		token->len = end - rest->ptr;
+		rest->len -= token->len + 1;
+		rest->ptr = end + 1;
+	}
+	return 1;
+}
+
+StrView strview_trim(StrView view) {
+	size_t skip;
+
+	skip = scan_skip_space(view.ptr, view.len);
+	view.ptr += skip;
+	view.len -= skip;
+	while (view.len > 0 && is_space(view.ptr[view.len - 1])) {
+		view.len--;
+	}
+	return view;
+}
+
+ptrdiff_t strview_find_char(StrView view, char c) {
+	const char *found;
+
+	found = (const char *)memchr(view.ptr, c, view.len);
+	return found != NULL ? found - view.ptr : -1;
+}
+
+ptrdiff_t strview_find(StrView haystack, StrView needle) {
+	size_t i;
+
+	if (needle.len == 0) {
+		return 0;
+	}
+	for (i = 0; i + needle.len <= haystack.len; i++) {
+		if (haystack.ptr[i] == needle.ptr[0] &&
+			memcmp(haystack.ptr + i, needle.ptr, needle.len) == 0) {
+			return (ptrdiff_t)i;
+		}
+	}
+	return -1;
+}
+
+int strview_cmp(StrView a, StrView b) {
+	size_t len;
+	int diff;
+
+	len = a.len < b.len ? a.len : b.len;
+	diff = len > 0 ? memcmp(a.ptr, b.ptr, len) : 0;
+	if (diff != 0) {
+		return diff;
+	}
+	return (a.len > b.len) - (a.len < b.len);
+}
+
+int strview_eq_cstr(StrView view, const char *str) {
+	return strlen(str) == view.len && memcmp(view.ptr, str, view.len) == 0;
+}
+
+String *string_from_view(Arena *arena, StrView view) {
+	String *st;
+	char *new_str;
+
+	st = (String *)arena_alloc(arena, sizeof(String));
+	new_str = (char *)arena_alloc_aligned(arena, view.len + 1, 1);
+	memcpy(new_str, view.ptr, view.len);
+	new_str[view.len] = '\0';
+
+	st->str = new_str;
+	st->length = view.len;
+
+	return st;
+}
@@ -0,0 +1,288 @@
+#include <cstring.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Byte scanning kernels. Every kernel has a portable scalar version, on x86
+ * SSE2 (always available on x86-64) and AVX2 versions are added and the best
+ * one is picked the first time the kernel is called.
+ * */
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+	(defined(__GNUC__) || defined(__clang__)) && defined(__SSE2__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+static int is_special(unsigned char c, char a, char b) {
+	return c <= ' ' || c == (unsigned char)a || c == (unsigned char)b;
+}
+
+static int is_space(unsigned char c) {
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static char to_lower(char c) {
+	return (c >= 'A' && c <= 'Z') ? (char)(c + ('a' - 'A')) : c;
+}
+
+static char to_upper(char c) {
+	return (c >= 'a' && c <= 'z') ? (char)(c - ('a' - 'A')) : c;
+}
+
+static size_t find_special_scalar(const char *ptr, size_t len, char a,
+								  char b) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (is_special((unsigned char)ptr[i], a, b)) {
+			break;
+		}
+	}
+	return i;
+}
+
+static size_t skip_space_scalar(const char *ptr, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (!is_space((unsigned char)ptr[i])) {
+			break;
+		}
+	}
+	return i;
+}
+
+static void case_scalar(char *dst, const char *src, size_t len, int upper) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		dst[i] = upper ? to_upper(src[i]) : to_lower(src[i]);
+	}
+}
+
+static int casecmp_scalar(const char *a, const char *b, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		char ca = to_lower(a[i]);
+		char cb = to_lower(b[i]);
+		if (ca != cb) {
+			return (unsigned char)ca - (unsigned char)cb;
+		}
+	}
+	return 0;
+}
+
+#ifdef SCAN_X86
+
+/* Bytes `lo` <= x <= `lo + span` as an all-ones mask, unsigned */
+#define SSE_IN_RANGE(x, lo, span)                                              \
+	_mm_cmpeq_epi8(_mm_min_epu8(_mm_sub_epi8((x), _mm_set1_epi8(lo)),          \
+								_mm_set1_epi8(span)),                          \
+				   _mm_sub_epi8((x), _mm_set1_epi8(lo)))
+
+#define AVX_IN_RANGE(x, lo, span)                                              \
+	_mm256_cmpeq_epi8(                                                         \
+		_mm256_min_epu8(_mm256_sub_epi8((x), _mm256_set1_epi8(lo)),            \
+						_mm256_set1_epi8(span)),                               \
+		_mm256_sub_epi8((x), _mm256_set1_epi8(lo)))
+
+static size_t find_special_sse2(const char *ptr, size_t len, char a, char b) {
+	size_t i = 0;
+	__m128i va = _mm_set1_epi8(a);
+	__m128i vb = _mm_set1_epi8(b);
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(ptr + i));
+		__m128i hit = _mm_or_si128(
+			SSE_IN_RANGE(x, 0, ' '),
+			_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)));
+		int mask = _mm_movemask_epi8(hit);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + find_special_scalar(ptr + i, len - i, a, b);
+}
+
+AVX2_TARGET static size_t find_special_avx2(const char *ptr, size_t len,
+											char a, char b) {
+	size_t i = 0;
+	__m256i va = _mm256_set1_epi8(a);
+	__m256i vb = _mm256_set1_epi8(b);
+	for (; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(ptr + i));
+		__m256i hit = _mm256_or_si256(
+			AVX_IN_RANGE(x, 0, ' '),
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, va),
+							_mm256_cmpeq_epi8(x, vb)));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + find_special_scalar(ptr + i, len - i, a, b);
+}
+
+static size_t skip_space_sse2(const char *ptr, size_t len) {
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(ptr + i));
+		__m128i space =
+			_mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')),
+						 SSE_IN_RANGE(x, '\t', '\r' - '\t'));
+		int mask = ~_mm_movemask_epi8(space) & 0xFFFF;
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + skip_space_scalar(ptr + i, len - i);
+}
+
+AVX2_TARGET static size_t skip_space_avx2(const char *ptr, size_t len) {
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(ptr + i));
+		__m256i space =
+			_mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')),
+							AVX_IN_RANGE(x, '\t', '\r' - '\t'));
+		unsigned mask = ~(unsigned)_mm256_movemask_epi8(space);
+		if (mask != 0) {
+			return i + __builtin_ctz(mask);
+		}
+	}
+	return i + skip_space_scalar(ptr + i, len - i);
+}
+
+/* Flips bit 0x20 of every letter in [lo, lo + 25] */
+static void case_sse2(char *dst, const char *src, size_t len, int upper) {
+	size_t i = 0;
+	char lo = upper ? 'a' : 'A';
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i letters = SSE_IN_RANGE(x, lo, 25);
+		x = _mm_xor_si128(x, _mm_and_si128(letters, _mm_set1_epi8(0x20)));
+		_mm_storeu_si128((__m128i *)(dst + i), x);
+	}
+	case_scalar(dst + i, src + i, len - i, upper);
+}
+
+AVX2_TARGET static void case_avx2(char *dst, const char *src, size_t len,
+								  int upper) {
+	size_t i = 0;
+	char lo = upper ? 'a' : 'A';
+	for (; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+		__m256i letters = AVX_IN_RANGE(x, lo, 25);
+		x = _mm256_xor_si256(x,
+							 _mm256_and_si256(letters, _mm256_set1_epi8(0x20)));
+		_mm256_storeu_si256((__m256i *)(dst + i), x);
+	}
+	case_scalar(dst + i, src + i, len - i, upper);
+}
+
+static int casecmp_sse2(const char *a, const char *b, size_t len) {
+	size_t i = 0;
+	__m128i bit = _mm_set1_epi8(0x20);
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+		x = _mm_or_si128(x, _mm_and_si128(SSE_IN_RANGE(x, 'A', 25), bit));
+		y = _mm_or_si128(y, _mm_and_si128(SSE_IN_RANGE(y, 'A', 25), bit));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xFFFF) {
+			break;
+		}
+	}
+	return casecmp_scalar(a + i, b + i, len - i);
+}
+
+AVX2_TARGET static int casecmp_avx2(const char *a, const char *b, size_t len) {
+	size_t i = 0;
+	__m256i bit = _mm256_set1_epi8(0x20);
+	for (; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+		x = _mm256_or_si256(x,
+							_mm256_and_si256(AVX_IN_RANGE(x, 'A', 25), bit));
+		y = _mm256_or_si256(y,
+							_mm256_and_si256(AVX_IN_RANGE(y, 'A', 25), bit));
+		if ((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) !=
+			0xFFFFFFFFu) {
+			break;
+		}
+	}
+	return casecmp_scalar(a + i, b + i, len - i);
+}
+
+#endif // SCAN_X86
+
+typedef struct {
+	size_t (*find_special)(const char *, size_t, char, char);
+	size_t (*skip_space)(const char *, size_t);
+	void (*change_case)(char *, const char *, size_t, int);
+	int (*casecmp)(const char *, const char *, size_t);
+} ScanKernels;
+
+static const ScanKernels scalar_kernels = {
+	find_special_scalar, skip_space_scalar, case_scalar, casecmp_scalar};
+#ifdef SCAN_X86
+static const ScanKernels sse2_kernels = {find_special_sse2, skip_space_sse2,
+										 case_sse2, casecmp_sse2};
+static const ScanKernels avx2_kernels = {find_special_avx2, skip_space_avx2,
+										 case_avx2, casecmp_avx2};
+#endif
+
+/* Published as a single pointer to a complete table, a thread racing the
+ * first call sees either NULL or a whole table and picks the same one */
+static const ScanKernels *kernels;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOAD_KERNELS() __atomic_load_n(&kernels, __ATOMIC_ACQUIRE)
+#define STORE_KERNELS(table) __atomic_store_n(&kernels, table, __ATOMIC_RELEASE)
+#else
+#define LOAD_KERNELS() (kernels)
+#define STORE_KERNELS(table) (kernels = (table))
+#endif
+
+static const ScanKernels *scan_kernels(void) {
+	const ScanKernels *table = LOAD_KERNELS();
+	if (table != NULL) {
+		return table;
+	}
+
+	table = &scalar_kernels;
+#ifdef SCAN_X86
+	table = &sse2_kernels;
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		table = &avx2_kernels;
+	}
+#endif
+	STORE_KERNELS(table);
+	return table;
+}
+
+const char *scan_kernel_name(void) {
+#ifdef SCAN_X86
+	return scan_kernels() == &avx2_kernels ? "avx2" : "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+size_t scan_find_special(const char *ptr, size_t len, char a, char b) {
+	return scan_kernels()->find_special(ptr, len, a, b);
+}
+
+size_t scan_skip_space(const char *ptr, size_t len) {
+	return scan_kernels()->skip_space(ptr, len);
+}
+
+void scan_to_upper(char *dst, const char *src, size_t len) {
+	scan_kernels()->change_case(dst, src, len, 1);
+}
+
+void scan_to_lower(char *dst, const char *src, size_t len) {
+	scan_kernels()->change_case(dst, src, len, 0);
+}
+
+int scan_casecmp(const char *a, const char *b, size_t len) {
+	return scan_kernels()->casecmp(a, b, len);
+}
@@ -6,6 +6,20 @@
 
 typedef struct Arena Arena;
 
+/* Capacity of the first block of a reserved arena */
+#define ARENA_DEFAULT_CAPACITY (64 * 1024)
+
+/* `arena_init_reserved` flag, backs the reservation with transparent huge
+ * pages where the system supports them */
+#define ARENA_HUGE_PAGES 1
+
+/* Position in an arena returned by `arena_mark`, everything allocated after
+ * it is released by `arena_rewind` */
+typedef struct {
+	void *block;
+	size_t size;
+} ArenaMark;
+
 /* Allocates memory on Heap with maximum memory alignment */
 void *m_align_alloc(size_t capacity);
 
@@ -18,13 +32,33 @@ void *m_align_realloc(void *ptr, size_t old_size, size_t new_size);
 /* Initiates an arena with the given capacity */
 Arena *arena_init(size_t capacity);
 
-/* Allocates a chunk on the arena, when the arena
- * gets full, it calls `arena_init` again internally to allocate more memory */
+/* Reserves `reserve` bytes of address space and commits pages on demand, the
+ * arena stays a single contiguous block until the reservation is used up.
+ * Falls back to `arena_init` where memory mapping isn't available */
+Arena *arena_init_reserved(size_t reserve, int flags);
+
+/* Allocates a chunk on the arena with maximum memory alignment, when the
+ * current block gets full a new block twice as large is chained. The memory
+ * is not zeroed */
 void *arena_alloc(Arena *arena, size_t size);
 
+/* Same as `arena_alloc` but aligned to `alignment`, which must be a power of
+ * two */
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment);
+
+/* Same as `arena_alloc` but the memory is zeroed */
+void *arena_alloc_zeroed(Arena *arena, size_t size);
+
 /* Frees the arena and all the allocations done on it */
 void arena_free(Arena **arena);
 
+/* Records the current position of the arena */
+ArenaMark arena_mark(Arena *arena);
+
+/* Releases every allocation done since `mark` was taken, the blocks stay
+ * around and are reused by the following allocations */
+void arena_rewind(Arena *arena, ArenaMark mark);
+
 /* Wipes out all the allocations done on the arena and restores it to its
  * initial capacity */
 void arena_reset(Arena **arena);
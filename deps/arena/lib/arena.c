@@ -4,6 +4,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define ARENA_HAVE_MMAP 1
+#endif
+
 typedef union {
 	char c;
 	short s;
@@ -22,13 +28,45 @@ struct AlignMax {
 
 #define MAX_ALIGN offsetof(struct AlignMax, m)
 
-struct Arena {
-	void *region;
+/*
+ * An arena is a chain of blocks, allocations are bumped off the current
+ * block and a new block is only chained when the current one is full. Each
+ * new block is twice as large as the previous one (up to MAX_BLOCK), so the
+ * number of blocks stays logarithmic in the total size.
+ * */
+typedef struct ArenaBlock {
+	struct ArenaBlock *next;
 	size_t size;
 	size_t capacity;
-	struct Arena *next;
+} ArenaBlock;
+
+/*
+ * A reserved arena maps its whole range PROT_NONE up front and makes pages
+ * readable and writable as the head block grows, so the head block never
+ * moves and never needs a successor. Only when the reservation runs out are
+ * regular blocks chained after it.
+ * */
+struct Arena {
+	ArenaBlock *head;
+	ArenaBlock *current;
+	size_t initial_capacity;
+	size_t next_capacity;
+	/* 0 unless the head block lives in a reservation */
+	size_t reserved;
+	size_t committed;
+	size_t commit_granularity;
 };
 
+#define MAX_BLOCK ((size_t)64 * 1024 * 1024)
+/* Transparent huge page size on x86-64 and most arm64 kernels */
+#define ARENA_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+/* Header size rounded up so the block data starts at maximum alignment */
+#define BLOCK_HEADER                                                          \
+	((sizeof(ArenaBlock) + MAX_ALIGN - 1) & ~(size_t)(MAX_ALIGN - 1))
+
+#define BLOCK_DATA(block) ((char *)(block) + BLOCK_HEADER)
+
 void *m_align_alloc(size_t capacity) {
 	size_t alignment;
 	size_t header_size;
@@ -135,83 +173,263 @@ void *m_align_realloc(void *ptr, size_t old_size, size_t new_size) {
 	return new_ptr;
 }
 
+static ArenaBlock *arena_block_new(size_t capacity) {
+	ArenaBlock *block;
+
+	block = (ArenaBlock *)malloc(BLOCK_HEADER + capacity);
+	if (block == NULL) {
+		fprintf(stderr, "Fatal: Failed to allocate arena");
+		abort();
+	}
+	block->next = NULL;
+	block->size = 0;
+	block->capacity = capacity;
+
+	return block;
+}
+
 Arena *arena_init(size_t capacity) {
 	Arena *arena;
-	void *data;
 
-	arena = (Arena *)m_align_alloc(sizeof(Arena));
-	data = m_align_alloc(capacity);
-
-	if (arena == NULL || data == NULL) {
+	arena = (Arena *)malloc(sizeof(Arena));
+	if (arena == NULL) {
 		fprintf(stderr, "Fatal: Failed to allocate arena");
 		abort();
 	}
 
-	arena->region = data;
-	arena->capacity = capacity;
-	arena->size = 0;
-	arena->next = NULL;
+	arena->head = arena_block_new(capacity);
+	arena->current = arena->head;
+	arena->initial_capacity = capacity;
+	arena->next_capacity = capacity;
+	arena->reserved = 0;
+	arena->committed = 0;
+	arena->commit_granularity = 0;
 
 	return arena;
 }
 
-void *arena_alloc(Arena *arena, size_t size) {
-	Arena *current_arena;
-	void *data;
-	Arena *new_arena;
+#ifdef ARENA_HAVE_MMAP
+/* Makes the head block of a reserved arena at least `capacity` bytes large,
+ * returns 0 when the reservation can't hold it */
+static int arena_commit(Arena *arena, size_t capacity) {
+	size_t needed;
+	size_t target;
+
+	needed = BLOCK_HEADER + capacity;
+	if (needed > arena->reserved) {
+		return 1;
+	}
 
-	current_arena = arena;
-	data = NULL;
+	/* commit geometrically so the number of mprotect calls stays small */
+	target = arena->committed * 2;
+	if (target < needed) {
+		target = needed;
+	}
+	target = (target + arena->commit_granularity - 1) &
+			 ~(arena->commit_granularity - 1);
+	if (target > arena->reserved) {
+		target = arena->reserved;
+	}
 
-	/*
-	 * if the element fits in the arena, then store it.
-	 * */
-	if (current_arena->size + size <= current_arena->capacity) {
-		data = (char *)current_arena->region + current_arena->size;
-		current_arena->size += size;
+	if (mprotect(arena->head, target, PROT_READ | PROT_WRITE) != 0) {
+		return 1;
 	}
-	/*
-	 * if it doesn't fit, check if it has any other arena attached to it.
-	 * if no arena is attached, then allocate a new one.
-	 * */
-	else {
-		if (current_arena->next != NULL) {
-			current_arena = current_arena->next;
-			data = arena_alloc(current_arena, size);
-		} else {
-			new_arena = NULL;
-			if (current_arena->capacity < size) {
-				new_arena = arena_init(size);
-			} else {
-				new_arena = arena_init(arena->capacity);
-			}
-			current_arena->next = new_arena;
-			data = arena_alloc(new_arena, size);
+	arena->committed = target;
+	arena->head->capacity = target - BLOCK_HEADER;
+	return 0;
+}
+#endif
+
+Arena *arena_init_reserved(size_t reserve, int flags) {
+#ifdef ARENA_HAVE_MMAP
+	Arena *arena;
+	void *base;
+	size_t page;
+	size_t align;
+	size_t lead;
+
+	page = (size_t)sysconf(_SC_PAGESIZE);
+	/* a huge page can only back a whole 2 MB aligned range, so the
+	 * reservation starts and ends on one */
+	align = (flags & ARENA_HUGE_PAGES) ? ARENA_HUGE_PAGE_SIZE : page;
+	reserve = (reserve + align - 1) & ~(align - 1);
+
+	base = mmap(NULL, reserve + align - page, PROT_NONE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		return arena_init(ARENA_DEFAULT_CAPACITY);
+	}
+	lead = (((size_t)base + align - 1) & ~(align - 1)) - (size_t)base;
+	if (lead > 0) {
+		munmap(base, lead);
+	}
+	if (align - page - lead > 0) {
+		munmap((char *)base + lead + reserve, align - page - lead);
+	}
+	base = (char *)base + lead;
+#ifdef MADV_HUGEPAGE
+	if (flags & ARENA_HUGE_PAGES) {
+		madvise(base, reserve, MADV_HUGEPAGE);
+	}
+#endif
+
+	arena = (Arena *)malloc(sizeof(Arena));
+	if (arena == NULL) {
+		fprintf(stderr, "Fatal: Failed to allocate arena");
+		abort();
+	}
+	arena->head = (ArenaBlock *)base;
+	arena->current = arena->head;
+	arena->initial_capacity = ARENA_DEFAULT_CAPACITY;
+	arena->next_capacity = ARENA_DEFAULT_CAPACITY;
+	arena->reserved = reserve;
+	arena->committed = 0;
+	arena->commit_granularity = align;
+
+	if (arena_commit(arena, ARENA_DEFAULT_CAPACITY)) {
+		munmap(base, reserve);
+		free(arena);
+		return arena_init(ARENA_DEFAULT_CAPACITY);
+	}
+	arena->head->next = NULL;
+	arena->head->size = 0;
+
+	return arena;
+#else
+	(void)reserve;
+	(void)flags;
+	return arena_init(ARENA_DEFAULT_CAPACITY);
+#endif
+}
+
+/* Returns the offset of the first `alignment` aligned byte at or after
+ * `size` in the block, or (size_t)-1 when `size` bytes don't fit there */
+static size_t arena_block_fit(ArenaBlock *block, size_t size,
+							  size_t alignment) {
+	size_t addr;
+	size_t offset;
+
+	addr = (size_t)BLOCK_DATA(block) + block->size;
+	offset = block->size + (((addr + alignment - 1) & ~(alignment - 1)) - addr);
+	if (offset > block->capacity || block->capacity - offset < size) {
+		return (size_t)-1;
+	}
+	return offset;
+}
+
+void *arena_alloc_aligned(Arena *arena, size_t size, size_t alignment) {
+	ArenaBlock *block;
+	size_t offset;
+	size_t capacity;
+
+	if (alignment == 0) {
+		alignment = 1;
+	}
+
+	block = arena->current;
+	offset = arena_block_fit(block, size, alignment);
+
+	/* blocks after the current one are empty, reuse them before growing */
+	while (offset == (size_t)-1 && block->next != NULL) {
+		block = block->next;
+		block->size = 0;
+		offset = arena_block_fit(block, size, alignment);
+	}
+
+#ifdef ARENA_HAVE_MMAP
+	if (offset == (size_t)-1 && block == arena->head && arena->reserved != 0 &&
+		arena_commit(arena, block->size + alignment + size) == 0) {
+		offset = arena_block_fit(block, size, alignment);
+	}
+#endif
+
+	if (offset == (size_t)-1) {
+		if (arena->next_capacity < MAX_BLOCK) {
+			arena->next_capacity *= 2;
+		}
+		capacity = arena->next_capacity;
+		if (capacity < size + alignment) {
+			capacity = size + alignment;
 		}
+		block->next = arena_block_new(capacity);
+		block = block->next;
+		offset = arena_block_fit(block, size, alignment);
 	}
 
+	arena->current = block;
+	block->size = offset + size;
+	return BLOCK_DATA(block) + offset;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+	return arena_alloc_aligned(arena, size, MAX_ALIGN);
+}
+
+void *arena_alloc_zeroed(Arena *arena, size_t size) {
+	void *data;
+
+	data = arena_alloc(arena, size);
+	memset(data, 0, size);
 	return data;
 }
 
+ArenaMark arena_mark(Arena *arena) {
+	ArenaMark mark;
+
+	mark.block = arena->current;
+	mark.size = arena->current->size;
+	return mark;
+}
+
+void arena_rewind(Arena *arena, ArenaMark mark) {
+	arena->current = (ArenaBlock *)mark.block;
+	arena->current->size = mark.size;
+}
+
 void arena_free(Arena **arena) {
+	ArenaBlock *block;
+	ArenaBlock *next;
+
 	if (*arena == NULL) {
 		return;
 	}
-	if ((*arena)->next != NULL) {
-		arena_free(&(*arena)->next);
+	for (block = (*arena)->head->next; block != NULL; block = next) {
+		next = block->next;
+		free(block);
 	}
-	m_align_free((*arena)->region);
-	(*arena)->region = NULL;
-	m_align_free(*arena);
+#ifdef ARENA_HAVE_MMAP
+	if ((*arena)->reserved != 0) {
+		munmap((*arena)->head, (*arena)->reserved);
+	} else {
+		free((*arena)->head);
+	}
+#else
+	free((*arena)->head);
+#endif
+	free(*arena);
 	*arena = NULL;
-	return;
 }
 
 void arena_reset(Arena **arena) {
-	Arena *next;
-	(*arena)->size = 0;
-	next = (*arena)->next;
-	arena_free(&next);
-	(*arena)->next = NULL;
-	memset((*arena)->region, 0, (*arena)->capacity);
+	ArenaBlock *block;
+	ArenaBlock *next;
+
+	for (block = (*arena)->head->next; block != NULL; block = next) {
+		next = block->next;
+		free(block);
+	}
+	(*arena)->head->next = NULL;
+	(*arena)->head->size = 0;
+	(*arena)->current = (*arena)->head;
+	(*arena)->next_capacity = (*arena)->initial_capacity;
+
+#ifdef ARENA_HAVE_MMAP
+	/* hand the pages back, they read as zero when touched again */
+	if ((*arena)->reserved != 0 &&
+		(*arena)->committed > (*arena)->commit_granularity) {
+		madvise((char *)(*arena)->head + (*arena)->commit_granularity,
+				(*arena)->committed - (*arena)->commit_granularity,
+				MADV_DONTNEED);
+	}
+#endif
 }
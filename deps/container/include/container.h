@@ -2,9 +2,19 @@
 #define CONTAINER_H
 
 #include <stddef.h>
+#include <stdlib.h>
 
 typedef struct Vector Vector;
 
+/* Fields are exposed so appends and lookups can be inlined, use the functions
+ * below rather than touching them */
+struct Vector {
+	size_t element_size;
+	size_t capacity;
+	size_t length;
+	char *items;
+};
+
 #define CONCAT2(a, b) a##b
 #define CONCAT(a, b) CONCAT2(a, b)
 
@@ -12,17 +22,36 @@ typedef struct Vector Vector;
 Vector *vector_init_impl(size_t element_size);
 #define vector_init(TYPE) vector_init_impl(sizeof(TYPE))
 
+// Grows the vector so at least `capacity` elements fit without reallocating
+void vector_reserve(Vector *vector, size_t capacity);
+
+// Returns the slot for a new element at the end, growing the vector if needed
+static inline void *vector_push_slot(Vector *vector) {
+	if (vector->length == vector->capacity) {
+		vector_reserve(vector, vector->length + 1);
+	}
+	return vector->items + vector->length++ * vector->element_size;
+}
+
 // Wrapper definition for append_impl
 void append_impl(Vector *v, const void *element);
-// will be used for appending values directly
+// will be used for appending values directly, compiles to a typed store
 #define append(type, vec, value)                                               \
 	do {                                                                       \
 		type CONCAT(_tmp_, __LINE__) = (value);                                \
-		append_impl((vec), &CONCAT(_tmp_, __LINE__));                          \
+		*(type *)vector_push_slot((vec)) = CONCAT(_tmp_, __LINE__);            \
 	} while (0)
 
+// Appends `count` elements stored contiguously at `elements`
+void append_n(Vector *vector, const void *elements, size_t count);
+
 // Wrapper definition for at_impl
-void *at_impl(Vector *vector, int pos);
+static inline void *at_impl(Vector *vector, size_t pos) {
+	if (pos < vector->length) {
+		return vector->items + pos * vector->element_size;
+	}
+	return NULL;
+}
 #define at(TYPE, vec, pos) (*(TYPE *)at_impl((vec), (pos)))
 
 // Wrapper definition for pop_impl
@@ -30,7 +59,7 @@ void *pop_impl(Vector *vector);
 #define pop(TYPE, vec) (*(TYPE *)pop_impl((vec)))
 
 // Wrapper definition for replace_at_impl
-void replace_at_impl(Vector *vector, int pos, const void *value);
+void replace_at_impl(Vector *vector, size_t pos, const void *value);
 // will be used for appending values directly
 #define replace_at(type, vec, pos, value)                                      \
 	do {                                                                       \
@@ -38,9 +67,105 @@ void replace_at_impl(Vector *vector, int pos, const void *value);
 		replace_at_impl((vec), (pos), &CONCAT(_tmp_, __LINE__));               \
 	} while (0)
 
-int length(Vector *vector);
+// Returned as an int, the type of the loop indices it is compared with
+static inline int length(Vector *vector) { return (int)vector->length; }
 
 // Frees underlying data structure
 void vector_free(Vector *vector);
 
+/*
+ * Declares a vector specialised for TYPE, named vector_NAME, e.g.
+ * `VECTOR_DECLARE(char_ptr, char *)`. Elements are stored and read as TYPE,
+ * no element size is carried around and no memcpy is involved. Zero
+ * initialise it, `vector_NAME_free` releases it.
+ * */
+#define VECTOR_DECLARE(NAME, TYPE)                                             \
+	typedef struct {                                                           \
+		TYPE *items;                                                           \
+		size_t length;                                                         \
+		size_t capacity;                                                       \
+	} vector_##NAME;                                                           \
+                                                                               \
+	static inline void vector_##NAME##_reserve(vector_##NAME *v,               \
+											   size_t capacity) {              \
+		if (capacity <= v->capacity) {                                         \
+			return;                                                            \
+		}                                                                      \
+		size_t grown = v->capacity ? v->capacity * 2 : 8;                      \
+		v->capacity = grown > capacity ? grown : capacity;                     \
+		v->items = (TYPE *)vector_realloc_items(v->items,                      \
+												v->capacity * sizeof(TYPE));   \
+	}                                                                          \
+                                                                               \
+	static inline void vector_##NAME##_push(vector_##NAME *v, TYPE value) {    \
+		if (v->length == v->capacity) {                                        \
+			vector_##NAME##_reserve(v, v->length + 1);                         \
+		}                                                                      \
+		v->items[v->length++] = value;                                         \
+	}                                                                          \
+                                                                               \
+	static inline void vector_##NAME##_free(vector_##NAME *v) {                \
+		free(v->items);                                                        \
+		v->items = NULL;                                                       \
+		v->length = 0;                                                         \
+		v->capacity = 0;                                                       \
+	}
+
+// realloc that aborts on failure, backs the typed vectors
+void *vector_realloc_items(void *items, size_t size);
+
+typedef struct HashMap HashMap;
+
+/* A set is a map without values */
+typedef HashMap HashSet;
+
+typedef size_t (*HashFn)(const char *key);
+typedef int (*KeyEqFn)(const char *a, const char *b);
+
+// Default hash (FNV-1a) and equality used when NULL is passed
+size_t hash_str(const char *key);
+int key_eq_str(const char *a, const char *b);
+
+// Wrapper definition for hashmap_init_impl, keys are strings which are not
+// copied, they have to outlive the map. Iteration follows insertion order
+HashMap *hashmap_init_impl(size_t value_size, HashFn hash, KeyEqFn eq);
+#define hashmap_init(TYPE) hashmap_init_impl(sizeof(TYPE), NULL, NULL)
+#define hashmap_init_with(TYPE, hash, eq)                                      \
+	hashmap_init_impl(sizeof(TYPE), (hash), (eq))
+
+// Wrapper definition for hashmap_put_impl, returns 1 when the key is new and
+// 0 when an existing value was replaced
+int hashmap_put_impl(HashMap *map, const char *key, const void *value);
+#define hashmap_put(type, map, key, value)                                     \
+	do {                                                                       \
+		type CONCAT(_tmp_, __LINE__) = (value);                                \
+		hashmap_put_impl((map), (key), &CONCAT(_tmp_, __LINE__));              \
+	} while (0)
+
+// Wrapper definition for hashmap_get_impl, NULL when the key is missing
+void *hashmap_get_impl(HashMap *map, const char *key);
+#define hashmap_get(TYPE, map, key) ((TYPE *)hashmap_get_impl((map), (key)))
+
+int hashmap_contains(HashMap *map, const char *key);
+
+int hashmap_size(HashMap *map);
+
+// Key and value at `pos` in insertion order
+const char *hashmap_key_at(HashMap *map, int pos);
+void *hashmap_value_at_impl(HashMap *map, int pos);
+#define hashmap_value_at(TYPE, map, pos)                                       \
+	(*(TYPE *)hashmap_value_at_impl((map), (pos)))
+
+// Frees the map, the keys are owned by the caller
+void hashmap_free(HashMap *map);
+
+#define hashset_init() hashmap_init_impl(0, NULL, NULL)
+#define hashset_init_with(hash, eq) hashmap_init_impl(0, (hash), (eq))
+// Returns 1 when the key was added and 0 when it was already present
+#define hashset_add(set, key) hashmap_put_impl((set), (key), NULL)
+#define hashset_contains(set, key) hashmap_contains((set), (key))
+#define hashset_size(set) hashmap_size((set))
+#define hashset_at(set, pos) hashmap_key_at((set), (pos))
+#define hashset_free(set) hashmap_free((set))
+
 #endif // CONTAINER_H
@@ -0,0 +1,164 @@
+#include <container.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Entries are kept in a dense array in insertion order, the open addressing
+ * table only stores `entry index + 1` (0 marks an empty slot) and is probed
+ * linearly. Growing the table never moves entries, so iteration order is
+ * always the order keys were first added.
+ * */
+typedef struct {
+	const char *key;
+	size_t hash;
+} HashEntry;
+
+struct HashMap {
+	HashFn hash;
+	KeyEqFn eq;
+	size_t value_size;
+	HashEntry *entries;
+	char *values;
+	int count;
+	int entry_capacity;
+	int *slots;
+	size_t slot_capacity;
+};
+
+/* FNV-1a */
+size_t hash_str(const char *key) {
+	uint64_t hash = 14695981039346656037ULL;
+	while (*key != '\0') {
+		hash ^= (unsigned char)*key++;
+		hash *= 1099511628211ULL;
+	}
+	return (size_t)hash;
+}
+
+int key_eq_str(const char *a, const char *b) { return strcmp(a, b) == 0; }
+
+static void fatal_alloc(void *ptr) {
+	if (ptr == NULL) {
+		abort();
+	}
+}
+
+HashMap *hashmap_init_impl(size_t value_size, HashFn hash, KeyEqFn eq) {
+	HashMap *map = (HashMap *)malloc(sizeof(HashMap));
+	fatal_alloc(map);
+	map->hash = hash != NULL ? hash : hash_str;
+	map->eq = eq != NULL ? eq : key_eq_str;
+	map->value_size = value_size;
+	map->entries = NULL;
+	map->values = NULL;
+	map->count = 0;
+	map->entry_capacity = 0;
+	map->slots = NULL;
+	map->slot_capacity = 0;
+	return map;
+}
+
+/* Returns the slot holding `key`, or the empty slot where it would go */
+static int *hashmap_slot(HashMap *map, const char *key, size_t hash) {
+	size_t mask = map->slot_capacity - 1;
+	size_t pos = hash & mask;
+	while (map->slots[pos] != 0) {
+		HashEntry *entry = &map->entries[map->slots[pos] - 1];
+		if (entry->hash == hash && map->eq(entry->key, key)) {
+			break;
+		}
+		pos = (pos + 1) & mask;
+	}
+	return &map->slots[pos];
+}
+
+static void hashmap_grow(HashMap *map) {
+	free(map->slots);
+	map->slot_capacity = map->slot_capacity ? map->slot_capacity * 2 : 16;
+	map->slots = (int *)calloc(map->slot_capacity, sizeof(int));
+	fatal_alloc(map->slots);
+
+	for (int i = 0; i < map->count; i++) {
+		*hashmap_slot(map, map->entries[i].key, map->entries[i].hash) = i + 1;
+	}
+}
+
+void *hashmap_get_impl(HashMap *map, const char *key) {
+	if (map->count == 0) {
+		return NULL;
+	}
+	int slot = *hashmap_slot(map, key, map->hash(key));
+	if (slot == 0) {
+		return NULL;
+	}
+	return map->values + (size_t)(slot - 1) * map->value_size;
+}
+
+int hashmap_contains(HashMap *map, const char *key) {
+	if (map->count == 0) {
+		return 0;
+	}
+	return *hashmap_slot(map, key, map->hash(key)) != 0;
+}
+
+int hashmap_put_impl(HashMap *map, const char *key, const void *value) {
+	if ((size_t)(map->count + 1) * 4 >= map->slot_capacity * 3) {
+		hashmap_grow(map);
+	}
+
+	size_t hash = map->hash(key);
+	int *slot = hashmap_slot(map, key, hash);
+	if (*slot != 0) {
+		if (map->value_size != 0) {
+			memcpy(map->values + (size_t)(*slot - 1) * map->value_size, value,
+				   map->value_size);
+		}
+		return 0;
+	}
+
+	if (map->count == map->entry_capacity) {
+		map->entry_capacity = map->entry_capacity ? map->entry_capacity * 2 : 8;
+		map->entries = (HashEntry *)realloc(
+			map->entries, sizeof(HashEntry) * map->entry_capacity);
+		fatal_alloc(map->entries);
+		if (map->value_size != 0) {
+			map->values = (char *)realloc(
+				map->values, map->value_size * map->entry_capacity);
+			fatal_alloc(map->values);
+		}
+	}
+
+	map->entries[map->count].key = key;
+	map->entries[map->count].hash = hash;
+	if (map->value_size != 0) {
+		memcpy(map->values + (size_t)map->count * map->value_size, value,
+			   map->value_size);
+	}
+	map->count++;
+	*slot = map->count;
+	return 1;
+}
+
+int hashmap_size(HashMap *map) { return map->count; }
+
+const char *hashmap_key_at(HashMap *map, int pos) {
+	if (pos >= 0 && pos < map->count) {
+		return map->entries[pos].key;
+	}
+	return NULL;
+}
+
+void *hashmap_value_at_impl(HashMap *map, int pos) {
+	if (pos >= 0 && pos < map->count && map->value_size != 0) {
+		return map->values + (size_t)pos * map->value_size;
+	}
+	return NULL;
+}
+
+void hashmap_free(HashMap *map) {
+	free(map->entries);
+	free(map->values);
+	free(map->slots);
+	free(map);
+}
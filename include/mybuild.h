@@ -3,6 +3,7 @@
 #include <cstring.h>
 #include <ctype.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,9 +21,14 @@
 #define GET_WD _getcwd
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <pthread.h>
 #include <strings.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #define MAKE_DIR(dir) mkdir(dir, 0777)
 #define STAT stat
@@ -31,52 +37,216 @@
 #endif
 
 #define BUFFER_SIZE 4096
+#define BUILD_LOG_PATH "./build/.cache/.build_log"
+#define DEPS_LOG_PATH "./build/.cache/.deps_log"
+#define DIR_INDEX_PATH "./build/.cache/.dir_index"
+#define PROJECT_MANIFEST "./myBuild.json"
+#define PROJECT_MODEL_PATH "./build/.cache/.project_model"
+
+typedef struct {
+	int jobs;
+	bool keep_going;
+	bool content_hash;
+	bool print_stats;
+	bool use_cache;
+} BuildOptions;
+
+/* Outcome of a job, `output` is what it wrote to stderr, kept (malloc'd)
+ * only when it succeeded */
+typedef struct {
+	bool succeeded;
+	char *output;
+	size_t output_len;
+} JobResult;
+
+typedef struct {
+	pid_t pid;
+	int err_fd;
+} Process;
+
+typedef struct {
+	long long mtime;
+	long long size;
+	bool exists;
+} FileStamp;
+
+/* Everything a build needs from the manifest, with directories scanned. The
+ * scanned file paths live in the path table, see path_intern */
+typedef struct {
+	char *cwd;
+	char *name;
+	char *compiler;
+	char *static_link;
+	bool is_exec;
+	/* relative to the project root, dependencies' prefixed with deps/<name> */
+	Vector *include_dirs;
+	Vector *flags;
+	Vector *lib_links;
+	Vector *sources;
+	/* only collected for libraries */
+	Vector *headers;
+	/* absolute paths */
+	Vector *stat_libs;
+	Vector *shared_libs;
+	/* names under `dependencies` and their versions, sources below
+	 * deps/<name> are built into that dependency's archive */
+	Vector *dependencies;
+	Vector *dep_versions;
+	/* manifest and directories the model was resolved from */
+	Vector *watched;
+	char *snapshot;
+} ProjectModel;
+
+/* Interned path, see path_intern */
+typedef uint32_t PathId;
+
+/* Dense PathId -> item map */
+typedef struct {
+	int *items;
+	size_t capacity;
+} PathIndex;
+
+typedef struct JobPool JobPool;
+typedef struct ThreadPool ThreadPool;
+typedef struct BuildLog BuildLog;
+typedef struct DepsLog DepsLog;
+typedef struct CompileCache CompileCache;
+typedef struct RemoteCache RemoteCache;
+typedef struct DepStore DepStore;
+
+typedef void (*ThreadTaskFn)(ThreadPool *pool, int worker, void *task,
+							 void *ctx);
 
 int create_append_file(char *file_path, char *content);
 void create_my_build_config(char *config_file_path, char *project_name,
 							char *project_lang, char *compiler_path,
 							bool isExec);
 int check_project_lang(char *lang);
-String *build_project(Arena *global_str_arena);
+String *build_project(Arena *global_str_arena, BuildOptions *opts);
 
-void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
+void fetch_library(HashSet *v, char *libURL, yyjson_mut_val *sync_src,
 				   yyjson_mut_val *sync_include_paths,
 				   yyjson_mut_val *sync_flags, yyjson_mut_val *sync_lib_links,
 				   yyjson_mut_val *sync_stat, yyjson_mut_val *sync_shared,
 				   bool sync);
-bool set_contains(Vector *v, char *elem);
-void set_add(Vector *v, char *elem);
+HashSet *string_set_init();
+bool set_contains(HashSet *set, char *elem);
+void set_add(HashSet *set, char *elem);
 String *clone_lib(Arena *arena, char *libURL);
 bool is_mybuild_config_present(char *filename);
 int init_project();
 String *collect_src_files(Arena *str_arena, String *path);
-String *collect_files(Arena *str_arena, String *path, String *type);
-Vector *string_split(Arena *arena, String *str, char sep);
-Vector *string_split_lines(Arena *arena, String *str);
 String *get_current_working_dir(Arena *arena);
 int generate_compile_commands();
-String *build_project(Arena *global_str_arena);
 char *get_repo_name(Arena *arena, const char *git_url);
 void add_library(char *libURL);
-void run_project(Arena *global_str_arena);
+void run_project(Arena *global_str_arena, BuildOptions *opts);
 void sync_dependency();
-void get_src_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-				 yyjson_val *deps, String *cwd);
-void get_header_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-					yyjson_val *deps, String *cwd);
-
-void get_stat_lib_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-					  yyjson_val *deps, String *cwd);
-void get_shared_lib_vec(Arena *str_arena, Vector *source_files,
-						yyjson_val *root, yyjson_val *deps, String *cwd);
 const char *get_filename_without_path(const char *path);
 int cli(int argc, char *argv[], Arena *global_str_arena);
+int parse_build_options(int argc, char *argv[], BuildOptions *opts);
 long long get_file_modified_time(const char *path);
-bool are_headers_newer(const char *d_file_path, long long obj_time);
+bool get_file_stamp(const char *path, FileStamp *stamp);
+void file_stamp_from_stat(struct stat *attr, FileStamp *stamp);
+Vector *read_dep_file(Arena *arena, const char *d_file_path);
 bool directory_exists(const char *path);
-String *get_flags(Arena *str_arena, yyjson_val *root, String *type);
 int copy_file(const char *src_path, const char *dest_path);
 bool file_exists(const char *file_name);
 void add_local_lib(int lib_count, char **lib_link);
 void add_flag(int lib_count, char **lib_link);
 bool check_if_dep_path(const char *str);
+void append_all(Vector *dest, Vector *src);
+void collect_files_glob(Arena *str_arena, Vector *files, char *pattern);
+bool path_glob_match(const char *pattern, const char *path);
+void remove_dir_files(const char *path);
+int make_dirs(char *path);
+const char *path_relative_to(const char *path, const char *dir);
+int get_cpu_count();
+JobPool *job_pool_init(Arena *arena, int max_jobs, bool keep_going);
+bool job_pool_submit(JobPool *pool, Vector *args, char *label,
+					 JobResult *result);
+int job_pool_wait(JobPool *pool);
+ThreadPool *thread_pool_init(int workers, ThreadTaskFn run, void *ctx);
+void thread_pool_submit(ThreadPool *pool, int worker, void *task);
+void thread_pool_run(ThreadPool *pool);
+void thread_pool_free(ThreadPool *pool);
+void split_command_words(Arena *arena, Vector *args, char *command);
+int process_spawn(Process *proc, Vector *args, const char *cwd,
+				  bool capture_stderr);
+int process_wait(Process *proc);
+int process_run(Vector *args, const char *cwd);
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed);
+uint64_t hash_string(const char *str, uint64_t seed);
+int hash_file(const char *path, uint64_t *digest);
+BuildLog *build_log_load(Arena *arena, const char *path);
+uint64_t build_log_get(BuildLog *log, PathId object);
+uint64_t build_log_get_inputs(BuildLog *log, PathId object);
+void build_log_set(BuildLog *log, PathId object, uint64_t command_hash,
+				   uint64_t inputs_digest);
+uint64_t build_log_get_link(BuildLog *log, PathId output);
+void build_log_set_link(BuildLog *log, PathId output, uint64_t link_hash);
+int build_log_prune_objects(BuildLog *log, PathId *objects, int count);
+uint64_t hash_file_stamps(Vector *paths, uint64_t seed);
+bool build_log_file_digest(BuildLog *log, PathId path, uint64_t *digest);
+uint64_t build_log_inputs_digest(BuildLog *log, DepsLog *deps_log,
+								 PathId object);
+int build_log_save(BuildLog *log, const char *path);
+void build_log_free(BuildLog *log);
+String *get_compiler_identity(Arena *arena, char *compiler);
+uint64_t hash_compile_command(String *compiler_identity, String *response,
+							  Vector *args);
+bool stat_cache_get(PathId path, FileStamp *stamp);
+long long stat_cache_mtime(PathId path);
+void stat_cache_invalidate(PathId path);
+void stat_cache_stats(long *hits, long *misses);
+void stat_cache_free();
+DepsLog *deps_log_open(Arena *arena, const char *path);
+int deps_log_lookup(DepsLog *log, PathId object, PathId **deps);
+int deps_log_record(DepsLog *log, PathId object, Vector *deps);
+int deps_log_ingest(DepsLog *log, PathId object, const char *d_file);
+bool deps_log_newer_than(DepsLog *log, PathId object, long long obj_time);
+void deps_log_close(DepsLog *log);
+PathId path_intern(const char *path);
+char *path_str(PathId id);
+PathId path_id_limit();
+void path_table_free();
+int path_index_get(PathIndex *index, PathId id);
+void path_index_put(PathIndex *index, PathId id, int item);
+void path_index_free(PathIndex *index);
+CompileCache *compile_cache_open(Arena *arena, char *cwd);
+uint64_t compile_cache_key(CompileCache *cache, String *compiler_identity,
+						   String *response, Vector *args);
+bool compile_cache_fetch(CompileCache *cache, BuildLog *log, uint64_t key,
+						 const char *obj, const char *d_file);
+void compile_cache_store(CompileCache *cache, BuildLog *log, uint64_t key,
+						 const char *obj, const char *d_file, char *output,
+						 size_t output_len);
+void compile_cache_stats(CompileCache *cache, long *hits, long *remote_hits,
+						 long *misses);
+void compile_cache_close(CompileCache *cache);
+char *compile_cache_dir(CompileCache *cache);
+int write_dep_file(const char *d_file, const char *obj, char *inputs);
+int cache_command(int argc, char *argv[]);
+RemoteCache *remote_cache_open(Arena *arena);
+bool remote_cache_writable(RemoteCache *remote);
+char *remote_cache_get(RemoteCache *remote, Arena *arena, const char *kind,
+					   uint64_t key, size_t *len);
+void remote_cache_put(RemoteCache *remote, const char *kind, uint64_t key,
+					  const char *data, size_t len);
+int remote_cache_serve(char *default_dir, int argc, char *argv[]);
+int launcher_command(int argc, char *argv[]);
+DepStore *dep_store_open(Arena *arena, char *cwd);
+uint64_t dep_store_key(DepStore *store, String *compiler_identity,
+					   String *response, Vector *sources);
+char *dep_store_lookup(DepStore *store, BuildLog *log, const char *name,
+					   const char *version, uint64_t key);
+char *dep_store_publish(DepStore *store, BuildLog *log, DepsLog *deps_log,
+						const char *name, const char *version, uint64_t key,
+						const char *archive, Vector *objects);
+void dep_store_close(DepStore *store);
+int store_command(int argc, char *argv[]);
+size_t lz_bound(size_t len);
+size_t lz_compress(const char *src, size_t len, char *dst);
+bool lz_decompress(const char *src, size_t len, char *dst, size_t out_len);
+ProjectModel *project_model_load(Arena *arena);
+void project_model_free(ProjectModel *model);
@@ -0,0 +1,372 @@
+#include <mybuild.h>
+
+#define BUILD_LOG_HEADER "# myBuild log v2"
+
+typedef struct {
+	PathId object;
+	uint64_t command_hash;
+	uint64_t inputs_digest;
+} BuildLogEntry;
+
+typedef struct {
+	PathId path;
+	long long mtime;
+	long long size;
+	uint64_t digest;
+	/* looked up by this build */
+	bool used;
+} FileDigest;
+
+struct BuildLog {
+	Arena *arena;
+	Vector *entries;
+	Vector *files;
+	Vector *links;
+	PathIndex entry_index;
+	PathIndex file_index;
+	PathIndex link_index;
+};
+
+static BuildLogEntry *build_log_find(BuildLog *log, PathId object) {
+	int item = path_index_get(&log->entry_index, object);
+	return item < 0 ? NULL : &at(BuildLogEntry, log->entries, item);
+}
+
+static FileDigest *build_log_find_file(BuildLog *log, PathId path) {
+	int item = path_index_get(&log->file_index, path);
+	return item < 0 ? NULL : &at(FileDigest, log->files, item);
+}
+
+/* The add functions replace the existing record of the path, if any, since
+ * paths that only differed before normalization share their ID */
+static void build_log_add(BuildLog *log, PathId object, uint64_t command_hash,
+						  uint64_t inputs_digest) {
+	BuildLogEntry *found = build_log_find(log, object);
+	if (found != NULL) {
+		found->command_hash = command_hash;
+		found->inputs_digest = inputs_digest;
+		return;
+	}
+
+	BuildLogEntry entry;
+	entry.object = object;
+	entry.command_hash = command_hash;
+	entry.inputs_digest = inputs_digest;
+	append(BuildLogEntry, log->entries, entry);
+	path_index_put(&log->entry_index, object, length(log->entries) - 1);
+}
+
+static void build_log_add_link(BuildLog *log, PathId output,
+							   uint64_t link_hash) {
+	int item = path_index_get(&log->link_index, output);
+	if (item >= 0) {
+		at(BuildLogEntry, log->links, item).command_hash = link_hash;
+		return;
+	}
+
+	BuildLogEntry entry;
+	entry.object = output;
+	entry.command_hash = link_hash;
+	entry.inputs_digest = 0;
+	append(BuildLogEntry, log->links, entry);
+	path_index_put(&log->link_index, output, length(log->links) - 1);
+}
+
+static void build_log_add_file(BuildLog *log, PathId path, long long mtime,
+							   long long size, uint64_t digest, bool used) {
+	FileDigest *found = build_log_find_file(log, path);
+	if (found != NULL) {
+		found->mtime = mtime;
+		found->size = size;
+		found->digest = digest;
+		found->used |= used;
+		return;
+	}
+
+	FileDigest file;
+	file.path = path;
+	file.mtime = mtime;
+	file.size = size;
+	file.digest = digest;
+	file.used = used;
+	append(FileDigest, log->files, file);
+	path_index_put(&log->file_index, path, length(log->files) - 1);
+}
+
+BuildLog *build_log_load(Arena *arena, const char *path) {
+	BuildLog *log = (BuildLog *)arena_alloc(arena, sizeof(BuildLog));
+	log->arena = arena;
+	log->entries = vector_init(BuildLogEntry);
+	log->files = vector_init(FileDigest);
+	log->links = vector_init(BuildLogEntry);
+	log->entry_index = (PathIndex){NULL, 0};
+	log->file_index = (PathIndex){NULL, 0};
+	log->link_index = (PathIndex){NULL, 0};
+
+	FILE *fp = fopen(path, "r");
+	if (fp == NULL) {
+		return log;
+	}
+
+	char line[BUFFER_SIZE];
+	if (fgets(line, sizeof(line), fp) == NULL ||
+		strncmp(line, BUILD_LOG_HEADER, strlen(BUILD_LOG_HEADER)) != 0) {
+		/* unknown or older format, start from scratch */
+		fclose(fp);
+		return log;
+	}
+
+	/*
+	 * o <command hash> <inputs digest> <object>
+	 * f <mtime> <size> <digest> <path>
+	 * l <link hash> <output>
+	 * */
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		unsigned long long command_hash, inputs_digest, digest;
+		long long mtime, size;
+		int consumed = 0;
+		line[strcspn(line, "\n")] = '\0';
+
+		if (sscanf(line, "o\t%llx\t%llx\t%n", &command_hash, &inputs_digest,
+				   &consumed) == 2 &&
+			consumed > 0) {
+			build_log_add(log, path_intern(line + consumed), command_hash,
+						  inputs_digest);
+		} else if (sscanf(line, "f\t%lld\t%lld\t%llx\t%n", &mtime, &size,
+						  &digest, &consumed) == 3 &&
+				   consumed > 0) {
+			build_log_add_file(log, path_intern(line + consumed), mtime, size,
+							   digest, false);
+		} else if (sscanf(line, "l\t%llx\t%n", &command_hash, &consumed) ==
+					   1 &&
+				   consumed > 0) {
+			build_log_add_link(log, path_intern(line + consumed),
+							   command_hash);
+		}
+	}
+
+	fclose(fp);
+	return log;
+}
+
+uint64_t build_log_get(BuildLog *log, PathId object) {
+	BuildLogEntry *entry = build_log_find(log, object);
+	return entry ? entry->command_hash : 0;
+}
+
+uint64_t build_log_get_inputs(BuildLog *log, PathId object) {
+	BuildLogEntry *entry = build_log_find(log, object);
+	return entry ? entry->inputs_digest : 0;
+}
+
+void build_log_set(BuildLog *log, PathId object, uint64_t command_hash,
+				   uint64_t inputs_digest) {
+	build_log_add(log, object, command_hash, inputs_digest);
+}
+
+uint64_t build_log_get_link(BuildLog *log, PathId output) {
+	int item = path_index_get(&log->link_index, output);
+	return item < 0 ? 0 : at(BuildLogEntry, log->links, item).command_hash;
+}
+
+void build_log_set_link(BuildLog *log, PathId output, uint64_t link_hash) {
+	build_log_add_link(log, output, link_hash);
+}
+
+/* Deletes the objects (and their `.d` files) of sources that are no longer
+ * part of the project, so they don't end up in the link. Returns how many
+ * were removed */
+int build_log_prune_objects(BuildLog *log, PathId *objects, int count) {
+	PathIndex current = {NULL, 0};
+	int removed = 0;
+
+	for (int i = 0; i < count; i++) {
+		path_index_put(&current, objects[i], i);
+	}
+
+	for (int i = 0; i < length(log->entries); i++) {
+		BuildLogEntry *entry = &at(BuildLogEntry, log->entries, i);
+		if (entry->command_hash == 0 ||
+			path_index_get(&current, entry->object) >= 0) {
+			continue;
+		}
+
+		String *d_file = string_from(log->arena, path_str(entry->object));
+		string(d_file)[string_len(d_file) - 1] = 'd';
+		unlink(path_str(entry->object));
+		unlink(string(d_file));
+		entry->command_hash = 0;
+		removed++;
+	}
+
+	path_index_free(&current);
+	return removed;
+}
+
+/* Hashes the size and modification time of every file, the cheap way of
+ * telling whether any link input changed */
+uint64_t hash_file_stamps(Vector *paths, uint64_t seed) {
+	uint64_t hash = seed;
+	for (int i = 0; i < length(paths); i++) {
+		char *path = at(char *, paths, i);
+		FileStamp file_stamp;
+		long long stamp[2] = {0, -1};
+		if (stat_cache_get(path_intern(path), &file_stamp)) {
+			stamp[0] = file_stamp.mtime;
+			stamp[1] = file_stamp.size;
+		}
+		hash = hash_string(path, hash);
+		hash = hash_bytes(stamp, sizeof(stamp), hash);
+	}
+	return hash;
+}
+
+/* Returns the content digest of a file, only re-reading it when its size or
+ * modification time differ from the recorded ones */
+bool build_log_file_digest(BuildLog *log, PathId path, uint64_t *digest) {
+	FileStamp stamp;
+	if (!stat_cache_get(path, &stamp)) {
+		return false;
+	}
+
+	FileDigest *file = build_log_find_file(log, path);
+	if (file != NULL && file->mtime == stamp.mtime &&
+		file->size == stamp.size) {
+		file->used = true;
+		*digest = file->digest;
+		return true;
+	}
+
+	if (hash_file(path_str(path), digest)) {
+		return false;
+	}
+
+	build_log_add_file(log, path, stamp.mtime, stamp.size, *digest, true);
+	return true;
+}
+
+/* Combines the digests of every input recorded for the object in the deps
+ * log, 0 when any of them can't be read */
+uint64_t build_log_inputs_digest(BuildLog *log, DepsLog *deps_log,
+								 PathId object) {
+	PathId *deps;
+	int count = deps_log_lookup(deps_log, object, &deps);
+	if (count < 0) {
+		return 0;
+	}
+
+	uint64_t combined = 0;
+	for (int i = 0; i < count; i++) {
+		uint64_t digest;
+		if (!build_log_file_digest(log, deps[i], &digest)) {
+			return 0;
+		}
+		combined = hash_string(path_str(deps[i]), combined);
+		combined = hash_bytes(&digest, sizeof(digest), combined);
+	}
+
+	return combined ? combined : 1;
+}
+
+int build_log_save(BuildLog *log, const char *path) {
+	String *tmp_path =
+		string_concat_cstr(log->arena, 2, (char *)path, ".tmp");
+	FILE *fp = fopen(string(tmp_path), "w");
+	if (fp == NULL) {
+		perror("fopen failed");
+		return 1;
+	}
+
+	fprintf(fp, "%s\n", BUILD_LOG_HEADER);
+	for (int i = 0; i < length(log->entries); i++) {
+		BuildLogEntry *entry = &at(BuildLogEntry, log->entries, i);
+		if (entry->command_hash == 0) {
+			continue;
+		}
+		fprintf(fp, "o\t%016llx\t%016llx\t%s\n",
+				(unsigned long long)entry->command_hash,
+				(unsigned long long)entry->inputs_digest,
+				path_str(entry->object));
+	}
+	for (int i = 0; i < length(log->links); i++) {
+		BuildLogEntry *link = &at(BuildLogEntry, log->links, i);
+		if (link->command_hash == 0) {
+			continue;
+		}
+		fprintf(fp, "l\t%016llx\t%s\n", (unsigned long long)link->command_hash,
+				path_str(link->object));
+	}
+	/* digests of files that were removed or changed since are dropped, so
+	 * renamed headers don't pile up */
+	for (int i = 0; i < length(log->files); i++) {
+		FileDigest *file = &at(FileDigest, log->files, i);
+		FileStamp stamp;
+		if (!file->used &&
+			(!stat_cache_get(file->path, &stamp) ||
+			 stamp.mtime != file->mtime || stamp.size != file->size)) {
+			continue;
+		}
+		fprintf(fp, "f\t%lld\t%lld\t%016llx\t%s\n", file->mtime, file->size,
+				(unsigned long long)file->digest, path_str(file->path));
+	}
+
+	if (fclose(fp) != 0 || rename(string(tmp_path), path) != 0) {
+		perror("Unable to write build log");
+		return 1;
+	}
+	return 0;
+}
+
+void build_log_free(BuildLog *log) {
+	vector_free(log->entries);
+	vector_free(log->files);
+	vector_free(log->links);
+	path_index_free(&log->entry_index);
+	path_index_free(&log->file_index);
+	path_index_free(&log->link_index);
+}
+
+/* Resolves the compiler executable through PATH when needed and describes it
+ * by path, size and modification time, so that upgrading or switching the
+ * compiler invalidates every object */
+String *get_compiler_identity(Arena *arena, char *compiler) {
+	Vector *words = vector_init(char *);
+	split_command_words(arena, words, compiler);
+	char *program = length(words) > 0 ? at(char *, words, 0) : compiler;
+	vector_free(words);
+
+	String *resolved = string_from(arena, program);
+	if (strchr(program, '/') == NULL) {
+		char *path_env = getenv("PATH");
+		StrView rest = strview_from(path_env != NULL ? path_env : "");
+		StrView dir;
+		char candidate[BUFFER_SIZE];
+		while (strview_split_next(&rest, ':', &dir)) {
+			snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)dir.len,
+					 dir.ptr, program);
+			if (access(candidate, X_OK) == 0) {
+				resolved = string_from(arena, candidate);
+				break;
+			}
+		}
+	}
+
+	struct stat attr;
+	char identity[64] = "";
+	if (stat(string(resolved), &attr) == 0) {
+		snprintf(identity, sizeof(identity), ":%lld:%lld",
+				 (long long)attr.st_size, (long long)attr.st_mtime);
+	}
+	return string_concat_cstr(arena, 2, compiler, identity);
+}
+
+uint64_t hash_compile_command(String *compiler_identity, String *response,
+							  Vector *args) {
+	uint64_t hash = hash_string(string(compiler_identity), 0);
+	hash = hash_string(string(response), hash);
+	for (int i = 0; i < length(args); i++) {
+		hash = hash_string(at(char *, args, i), hash);
+	}
+	/* 0 marks a missing record */
+	return hash ? hash : 1;
+}
@@ -1,12 +1,55 @@
 #include <mybuild.h>
 
+int parse_build_options(int argc, char *argv[], BuildOptions *opts) {
+	opts->jobs = get_cpu_count();
+	opts->keep_going = false;
+	opts->content_hash = false;
+	opts->print_stats = false;
+	opts->use_cache = true;
+
+	for (int i = 0; i < argc; i++) {
+		char *arg = argv[i];
+		if (strcmp(arg, "-j") == 0 || strcmp(arg, "--jobs") == 0) {
+			if (i + 1 >= argc) {
+				fprintf(stderr, "Missing value for %s\n", arg);
+				return 1;
+			}
+			opts->jobs = atoi(argv[++i]);
+		} else if (strncmp(arg, "-j", 2) == 0) {
+			opts->jobs = atoi(arg + 2);
+		} else if (strcmp(arg, "-k") == 0 ||
+				   strcmp(arg, "--keep-going") == 0) {
+			opts->keep_going = true;
+		} else if (strcmp(arg, "--content-hash") == 0) {
+			opts->content_hash = true;
+		} else if (strcmp(arg, "--stats") == 0) {
+			opts->print_stats = true;
+		} else if (strcmp(arg, "--no-cache") == 0) {
+			opts->use_cache = false;
+		} else {
+			fprintf(stderr, "Unknown build option: %s\n", arg);
+			return 1;
+		}
+	}
+
+	if (opts->jobs < 1) {
+		fprintf(stderr, "Invalid job count, expected a positive number\n");
+		return 1;
+	}
+	return 0;
+}
+
 int cli(int argc, char *argv[], Arena *global_str_arena) {
 	if (argc < 2) {
 		printf("Usage: myBuild <command> [args]\n");
-		printf("Commands: init, add <url>, build\n");
+		printf("Commands: init, add <url>, build, cache <stats|clear|serve>, "
+			   "cc -- <compiler> <args>, store gc\n");
+		printf("Build options: -j N, --keep-going, --content-hash, --stats, "
+			   "--no-cache\n");
 		return 1;
 	}
 	char *opt = argv[1];
+	BuildOptions opts;
 	if (STR_CMP(opt, "init") == 0) {
 		init_project();
 		return 0;
@@ -20,14 +63,25 @@ int cli(int argc, char *argv[], Arena *global_str_arena) {
 		add_flag(argc - 2, argv + 2);
 		return 0;
 	} else if (STR_CMP(opt, "build") == 0) {
-		build_project(global_str_arena);
-		return 0;
+		if (parse_build_options(argc - 2, argv + 2, &opts)) {
+			return 1;
+		}
+		return build_project(global_str_arena, &opts) == NULL ? 1 : 0;
 	} else if (STR_CMP(opt, "run") == 0) {
-		run_project(global_str_arena);
+		if (parse_build_options(argc - 2, argv + 2, &opts)) {
+			return 1;
+		}
+		run_project(global_str_arena, &opts);
 		return 0;
 	} else if (STR_CMP(opt, "gen") == 0) {
 		generate_compile_commands();
 		return 0;
+	} else if (STR_CMP(opt, "cache") == 0) {
+		return cache_command(argc - 2, argv + 2);
+	} else if (STR_CMP(opt, "store") == 0) {
+		return store_command(argc - 2, argv + 2);
+	} else if (STR_CMP(opt, "cc") == 0) {
+		return launcher_command(argc - 2, argv + 2);
 	} else if (STR_CMP(opt, "sync") == 0) {
 		sync_dependency();
 		return 0;
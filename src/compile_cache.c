@@ -0,0 +1,667 @@
+#include <mybuild.h>
+
+#include <sys/file.h>
+
+/*
+ * Object cache shared by every checkout on the machine, in the spirit of
+ * ccache's direct mode.
+ *
+ * A compile is first keyed by its command, with the project directory
+ * replaced so checkouts in different places agree. The manifest stored
+ * under that key lists the inputs (source and headers, as reported in the
+ * `.d` file) seen with the command so far. Hashing the current contents of
+ * one of those lists gives the key of a result: the object and whatever the
+ * compiler wrote to stderr.
+ *
+ * Every entry is a plain file. Hits touch their files and once the cache
+ * outgrows its limit the least recently used ones are removed. When a remote
+ * cache is configured, local misses are looked up there with the same keys
+ * and what it has is copied into the local cache.
+ * */
+
+/* v2 manifests list system headers too, older ones (possibly from a remote
+ * cache) are ignored so they can't match on project headers alone */
+#define CACHE_MANIFEST_HEADER "# myBuild manifest v2"
+#define CACHE_RESULT_MAGIC "MBOBJ\0\0\1"
+#define CACHE_MANIFEST_ENTRIES 8
+#define CACHE_DEFAULT_LIMIT ((long long)5 << 30)
+
+struct CompileCache {
+	Arena *scratch;
+	char *dir;
+	char *cwd;
+	size_t cwd_len;
+	long long limit;
+	RemoteCache *remote;
+	long hits;
+	long remote_hits;
+	long misses;
+	long long stored;
+};
+
+typedef struct {
+	char *path;
+	long long mtime;
+	long long size;
+} CacheFile;
+
+typedef struct {
+	long hits;
+	long misses;
+	long long size;
+} CacheStats;
+
+/* $MYBUILD_CACHE_DIR, or myBuild under $XDG_CACHE_HOME or ~/.cache */
+static String *cache_dir_path(Arena *arena) {
+	char *dir = getenv("MYBUILD_CACHE_DIR");
+	if (dir != NULL && dir[0] != '\0') {
+		return string_from(arena, dir);
+	}
+	dir = getenv("XDG_CACHE_HOME");
+	if (dir != NULL && dir[0] == '/') {
+		return string_concat_cstr(arena, 2, dir, "/myBuild");
+	}
+	dir = getenv("HOME");
+	if (dir != NULL && dir[0] != '\0') {
+		return string_concat_cstr(arena, 2, dir, "/.cache/myBuild");
+	}
+	return NULL;
+}
+
+/* $MYBUILD_CACHE_SIZE, in bytes or with a K, M or G suffix */
+static long long cache_size_limit() {
+	char *value = getenv("MYBUILD_CACHE_SIZE");
+	if (value == NULL || value[0] == '\0') {
+		return CACHE_DEFAULT_LIMIT;
+	}
+	char *end;
+	double size = strtod(value, &end);
+	switch (toupper((unsigned char)*end)) {
+	case 'G':
+		size *= 1024;
+		/* fallthrough */
+	case 'M':
+		size *= 1024;
+		/* fallthrough */
+	case 'K':
+		size *= 1024;
+		break;
+	}
+	return size > 0 ? (long long)size : CACHE_DEFAULT_LIMIT;
+}
+
+CompileCache *compile_cache_open(Arena *arena, char *cwd) {
+	String *dir = cache_dir_path(arena);
+	if (dir == NULL || make_dirs(string(dir))) {
+		return NULL;
+	}
+
+	CompileCache *cache = (CompileCache *)arena_alloc(arena, sizeof(*cache));
+	cache->scratch = arena_init(BUFFER_SIZE);
+	cache->dir = string(dir);
+	cache->cwd = cwd;
+	cache->cwd_len = strlen(cwd);
+	cache->limit = cache_size_limit();
+	cache->remote = remote_cache_open(arena);
+	cache->hits = 0;
+	cache->remote_hits = 0;
+	cache->misses = 0;
+	cache->stored = 0;
+	return cache;
+}
+
+char *compile_cache_dir(CompileCache *cache) { return cache->dir; }
+
+/* Hashes `str` with every occurrence of the project directory replaced */
+static uint64_t hash_normalized(CompileCache *cache, const char *str,
+								uint64_t hash) {
+	const char *found;
+	while (cache->cwd_len > 1 && (found = strstr(str, cache->cwd)) != NULL) {
+		hash = hash_bytes(str, found - str, hash);
+		hash = hash_bytes(".", 1, hash);
+		str = found + cache->cwd_len;
+	}
+	return hash_string(str, hash);
+}
+
+uint64_t compile_cache_key(CompileCache *cache, String *compiler_identity,
+						   String *response, Vector *args) {
+	uint64_t hash = hash_string(string(compiler_identity), 0);
+	hash = hash_normalized(cache, string(response), hash);
+	for (int i = 0; i < length(args); i++) {
+		hash = hash_normalized(cache, at(char *, args, i), hash);
+	}
+	return hash ? hash : 1;
+}
+
+/* `<cache>/<kind>/<first two digits>/<key>` */
+static char *cache_entry_path(CompileCache *cache, const char *kind,
+							  uint64_t key) {
+	char name[40];
+	snprintf(name, sizeof(name), "%02x/%016llx", (unsigned)(key >> 56),
+			 (unsigned long long)key);
+	return string(
+		string_concat_cstr(cache->scratch, 5, cache->dir, "/", kind, "/",
+						   name));
+}
+
+/* Combines the command key with the current contents of a manifest entry's
+ * inputs, 0 when one of them can't be read */
+static uint64_t cache_result_key(BuildLog *log, uint64_t key, char *inputs) {
+	uint64_t hash = key;
+	StrView rest = strview_from(inputs);
+	StrView input;
+	char path[BUFFER_SIZE];
+	while (strview_split_next(&rest, '\t', &input)) {
+		uint64_t digest;
+		snprintf(path, sizeof(path), "%.*s", (int)input.len, input.ptr);
+		if (!build_log_file_digest(log, path_intern(path), &digest)) {
+			return 0;
+		}
+		hash = hash_string(path, hash);
+		hash = hash_bytes(&digest, sizeof(digest), hash);
+	}
+	return hash ? hash : 1;
+}
+
+static char *read_whole_file(Arena *arena, const char *path, size_t *size) {
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) {
+		return NULL;
+	}
+	struct stat attr;
+	char *data = NULL;
+	if (fstat(fileno(in), &attr) == 0) {
+		data = (char *)arena_alloc_aligned(arena, attr.st_size + 1, 1);
+		*size = fread(data, 1, attr.st_size, in);
+		data[*size] = '\0';
+	}
+	fclose(in);
+	return data;
+}
+
+/* Writes next to `path` first so readers never see a partial file */
+static int write_file_atomic(const char *path, const void *data,
+							 size_t size) {
+	char tmp_path[BUFFER_SIZE];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+	FILE *out = fopen(tmp_path, "wb");
+	if (out == NULL) {
+		return 1;
+	}
+	int err = fwrite(data, 1, size, out) != size;
+	if (fclose(out) != 0 || err || rename(tmp_path, path) != 0) {
+		unlink(tmp_path);
+		return 1;
+	}
+	return 0;
+}
+
+/* Splits a manifest into its input lists, modifying `data` */
+static Vector *manifest_parse(char *data) {
+	Vector *entries = vector_init(char *);
+	if (data == NULL || strncmp(data, CACHE_MANIFEST_HEADER "\n",
+								strlen(CACHE_MANIFEST_HEADER) + 1) != 0) {
+		return entries;
+	}
+
+	char *line = data + strlen(CACHE_MANIFEST_HEADER) + 1;
+	char *end;
+	while ((end = strchr(line, '\n')) != NULL) {
+		*end = '\0';
+		if (line[0] != '\0') {
+			append(char *, entries, line);
+		}
+		line = end + 1;
+	}
+	return entries;
+}
+
+static Vector *manifest_read(CompileCache *cache, const char *path) {
+	size_t size;
+	return manifest_parse(read_whole_file(cache->scratch, path, &size));
+}
+
+/* Creates the shard directory an entry goes in */
+static void cache_entry_dir(char *path) {
+	char *slash = strrchr(path, '/');
+	*slash = '\0';
+	make_dirs(path);
+	*slash = '/';
+}
+
+/* Puts `inputs` first in a manifest, the oldest input list falls off. Returns
+ * the new content, NULL when it couldn't be written */
+static String *manifest_add(CompileCache *cache, char *manifest,
+							char *inputs) {
+	Vector *entries = manifest_read(cache, manifest);
+	StringBuilder sb;
+	string_builder_init(&sb, BUFFER_SIZE);
+	string_builder_append(&sb, CACHE_MANIFEST_HEADER "\n");
+	string_builder_append(&sb, inputs);
+	string_builder_append_char(&sb, '\n');
+	for (int i = 0, kept = 1;
+		 i < length(entries) && kept < CACHE_MANIFEST_ENTRIES; i++) {
+		char *entry = at(char *, entries, i);
+		if (strcmp(entry, inputs) != 0) {
+			string_builder_append(&sb, entry);
+			string_builder_append_char(&sb, '\n');
+			kept++;
+		}
+	}
+	vector_free(entries);
+
+	String *content = string_builder_finish(cache->scratch, &sb);
+	cache_entry_dir(manifest);
+	if (write_file_atomic(manifest, string(content), string_len(content))) {
+		return NULL;
+	}
+	cache->stored += string_len(content);
+	return content;
+}
+
+/* Writes the `.d` file the compiler would have written for these inputs,
+ * separated by tabs */
+int write_dep_file(const char *d_file, const char *obj, char *inputs) {
+	FILE *out = fopen(d_file, "w");
+	if (out == NULL) {
+		return 1;
+	}
+	fprintf(out, "%s: ", obj);
+	for (char *c = inputs; *c != '\0'; c++) {
+		if (*c == '\t') {
+			fputs(" \\\n ", out);
+		} else if (*c == ' ' || *c == '#') {
+			fprintf(out, "\\%c", *c);
+		} else if (*c == '$') {
+			fputs("$$", out);
+		} else {
+			fputc(*c, out);
+		}
+	}
+	fputc('\n', out);
+	return fclose(out) != 0;
+}
+
+/* Restores the object of a result and replays its stderr */
+static bool cache_restore(CompileCache *cache, const char *result,
+						  const char *obj) {
+	size_t size;
+	char *data = read_whole_file(cache->scratch, result, &size);
+	uint64_t obj_len, err_len;
+	if (data == NULL || size < 24 || memcmp(data, CACHE_RESULT_MAGIC, 8)) {
+		return false;
+	}
+	memcpy(&obj_len, data + 8, sizeof(obj_len));
+	memcpy(&err_len, data + 16, sizeof(err_len));
+	if (24 + obj_len + err_len != size ||
+		write_file_atomic(obj, data + 24, obj_len)) {
+		return false;
+	}
+	fwrite(data + 24 + obj_len, 1, err_len, stderr);
+	return true;
+}
+
+/* Looks the command up in the remote cache, copying the result that matches
+ * the current inputs and its manifest entry into the local cache */
+static bool cache_fetch_remote(CompileCache *cache, BuildLog *log,
+							   uint64_t key, const char *obj,
+							   const char *d_file) {
+	size_t size;
+	char *data = remote_cache_get(cache->remote, cache->scratch, "m", key,
+								  &size);
+	Vector *entries = manifest_parse(data);
+	bool found = false;
+
+	for (int i = 0; i < length(entries) && !found; i++) {
+		char *inputs = at(char *, entries, i);
+		uint64_t result_key = cache_result_key(log, key, inputs);
+		char *blob = result_key != 0
+						 ? remote_cache_get(cache->remote, cache->scratch, "r",
+											result_key, &size)
+						 : NULL;
+		if (blob == NULL) {
+			continue;
+		}
+		char *result = cache_entry_path(cache, "r", result_key);
+		cache_entry_dir(result);
+		if (write_file_atomic(result, blob, size)) {
+			continue;
+		}
+		/* a result that doesn't restore is not kept */
+		if (!cache_restore(cache, result, obj) ||
+			write_dep_file(d_file, obj, inputs)) {
+			unlink(result);
+			continue;
+		}
+		cache->stored += size;
+		manifest_add(cache, cache_entry_path(cache, "m", key), inputs);
+		cache->remote_hits++;
+		found = true;
+	}
+
+	vector_free(entries);
+	return found;
+}
+
+/* Restores the object and `.d` file of a compile done before with the same
+ * command and inputs */
+bool compile_cache_fetch(CompileCache *cache, BuildLog *log, uint64_t key,
+						 const char *obj, const char *d_file) {
+	ArenaMark mark = arena_mark(cache->scratch);
+	char *manifest = cache_entry_path(cache, "m", key);
+	Vector *entries = manifest_read(cache, manifest);
+	bool found = false;
+
+	for (int i = 0; i < length(entries) && !found; i++) {
+		char *inputs = at(char *, entries, i);
+		uint64_t result_key = cache_result_key(log, key, inputs);
+		if (result_key == 0) {
+			continue;
+		}
+		char *result = cache_entry_path(cache, "r", result_key);
+		if (!cache_restore(cache, result, obj) ||
+			write_dep_file(d_file, obj, inputs)) {
+			continue;
+		}
+		/* least recently used goes first */
+		utimensat(AT_FDCWD, result, NULL, 0);
+		utimensat(AT_FDCWD, manifest, NULL, 0);
+		found = true;
+	}
+
+	vector_free(entries);
+	if (!found && cache->remote != NULL) {
+		found = cache_fetch_remote(cache, log, key, obj, d_file);
+	}
+	arena_rewind(cache->scratch, mark);
+	if (found) {
+		cache->hits++;
+	} else {
+		cache->misses++;
+	}
+	return found;
+}
+
+/* Stores the object a compile just produced, together with the inputs its
+ * `.d` file lists. Anything that can't be cached is silently skipped */
+void compile_cache_store(CompileCache *cache, BuildLog *log, uint64_t key,
+						 const char *obj, const char *d_file, char *output,
+						 size_t output_len) {
+	ArenaMark mark = arena_mark(cache->scratch);
+	Vector *deps = read_dep_file(cache->scratch, d_file);
+	if (deps == NULL || length(deps) == 0) {
+		goto CLEANUP;
+	}
+
+	StringBuilder sb;
+	string_builder_init(&sb, BUFFER_SIZE);
+	/* paths inside the project are kept relative to it, so they are the
+	 * same in every checkout */
+	for (int i = 0; i < length(deps); i++) {
+		const char *dep = path_relative_to(at(char *, deps, i), cache->cwd);
+		if (strpbrk(dep, "\t\n") != NULL) {
+			string_builder_free(&sb);
+			goto CLEANUP;
+		}
+		if (i > 0) {
+			string_builder_append_char(&sb, '\t');
+		}
+		string_builder_append(&sb, dep);
+	}
+	char *inputs = string(string_builder_finish(cache->scratch, &sb));
+
+	uint64_t result_key = cache_result_key(log, key, inputs);
+	size_t obj_len;
+	char *obj_data = read_whole_file(cache->scratch, obj, &obj_len);
+	if (result_key == 0 || obj_data == NULL) {
+		goto CLEANUP;
+	}
+
+	char *result = cache_entry_path(cache, "r", result_key);
+	char *manifest = cache_entry_path(cache, "m", key);
+	uint64_t lengths[2] = {obj_len, output_len};
+	size_t size = 24 + obj_len + output_len;
+	char *data = (char *)arena_alloc_aligned(cache->scratch, size, 1);
+	memcpy(data, CACHE_RESULT_MAGIC, 8);
+	memcpy(data + 8, lengths, sizeof(lengths));
+	memcpy(data + 24, obj_data, obj_len);
+	if (output_len > 0) {
+		memcpy(data + 24 + obj_len, output, output_len);
+	}
+
+	cache_entry_dir(result);
+	if (write_file_atomic(result, data, size)) {
+		goto CLEANUP;
+	}
+	cache->stored += size;
+	String *content = manifest_add(cache, manifest, inputs);
+
+	/* the result goes up first, so a manifest never points at nothing */
+	if (cache->remote != NULL && content != NULL) {
+		remote_cache_put(cache->remote, "r", result_key, data, size);
+		remote_cache_put(cache->remote, "m", key, string(content),
+						 string_len(content));
+	}
+
+CLEANUP:
+	if (deps != NULL) {
+		vector_free(deps);
+	}
+	arena_rewind(cache->scratch, mark);
+}
+
+/* Every manifest and result, with size and modification time */
+static void cache_list_files(Arena *arena, const char *cache_dir,
+							 Vector *files) {
+	const char *kinds[] = {"m", "r"};
+	char path[BUFFER_SIZE];
+	for (int k = 0; k < 2; k++) {
+		snprintf(path, sizeof(path), "%s/%s", cache_dir, kinds[k]);
+		DIR *top = opendir(path);
+		struct dirent *shard;
+		while (top != NULL && (shard = readdir(top)) != NULL) {
+			if (shard->d_name[0] == '.') {
+				continue;
+			}
+			/* paths that don't fit are skipped, not truncated */
+			char shard_path[BUFFER_SIZE];
+			int len = snprintf(shard_path, sizeof(shard_path), "%s/%s", path,
+							   shard->d_name);
+			if (len < 0 || (size_t)len >= sizeof(shard_path)) {
+				continue;
+			}
+			DIR *dir = opendir(shard_path);
+			struct dirent *entry;
+			while (dir != NULL && (entry = readdir(dir)) != NULL) {
+				char file_path[BUFFER_SIZE];
+				struct stat attr;
+				len = snprintf(file_path, sizeof(file_path), "%s/%s",
+							   shard_path, entry->d_name);
+				if (len < 0 || (size_t)len >= sizeof(file_path) ||
+					entry->d_name[0] == '.' || stat(file_path, &attr) != 0 ||
+					!S_ISREG(attr.st_mode)) {
+					continue;
+				}
+				FileStamp stamp;
+				file_stamp_from_stat(&attr, &stamp);
+				CacheFile file = {string(string_from(arena, file_path)),
+								  stamp.mtime, stamp.size};
+				append(CacheFile, files, file);
+			}
+			if (dir != NULL) {
+				closedir(dir);
+			}
+		}
+		if (top != NULL) {
+			closedir(top);
+		}
+	}
+}
+
+static int compare_mtime(const void *a, const void *b) {
+	long long ma = ((const CacheFile *)a)->mtime;
+	long long mb = ((const CacheFile *)b)->mtime;
+	return (ma > mb) - (ma < mb);
+}
+
+/* Removes the least recently used files until the cache is below 90% of
+ * its limit, returns the size left */
+static long long cache_evict(Arena *arena, const char *cache_dir,
+							 long long limit) {
+	Vector *files = vector_init(CacheFile);
+	long long size = 0;
+	cache_list_files(arena, cache_dir, files);
+	for (int i = 0; i < length(files); i++) {
+		size += at(CacheFile, files, i).size;
+	}
+
+	qsort(files->items, length(files), sizeof(CacheFile), compare_mtime);
+	for (int i = 0; i < length(files) && size > limit / 10 * 9; i++) {
+		CacheFile *file = &at(CacheFile, files, i);
+		if (unlink(file->path) == 0) {
+			size -= file->size;
+		}
+	}
+	vector_free(files);
+	return size;
+}
+
+static void stats_read(FILE *fp, CacheStats *stats) {
+	stats->hits = 0;
+	stats->misses = 0;
+	stats->size = 0;
+	rewind(fp);
+	fscanf(fp, "hits %ld\nmisses %ld\nsize %lld\n", &stats->hits,
+		   &stats->misses, &stats->size);
+}
+
+static void stats_write(FILE *fp, CacheStats *stats) {
+	rewind(fp);
+	ftruncate(fileno(fp), 0);
+	fprintf(fp, "hits %ld\nmisses %ld\nsize %lld\n", stats->hits,
+			stats->misses, stats->size);
+	fflush(fp);
+}
+
+/* The counters are shared by every build using the cache, so they are
+ * updated under a lock. `size` is an estimate between evictions */
+static FILE *stats_open(Arena *arena, const char *cache_dir) {
+	String *path = string_concat_cstr(arena, 2, (char *)cache_dir, "/stats");
+	int fd = open(string(path), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		return NULL;
+	}
+	flock(fd, LOCK_EX);
+	FILE *fp = fdopen(fd, "r+");
+	if (fp == NULL) {
+		close(fd);
+	}
+	return fp;
+}
+
+void compile_cache_stats(CompileCache *cache, long *hits, long *remote_hits,
+						 long *misses) {
+	*hits = cache->hits;
+	*remote_hits = cache->remote_hits;
+	*misses = cache->misses;
+}
+
+/* Adds this build's counters to the shared ones and evicts when the cache
+ * grew past its limit */
+void compile_cache_close(CompileCache *cache) {
+	FILE *fp = stats_open(cache->scratch, cache->dir);
+	if (fp != NULL) {
+		CacheStats stats;
+		stats_read(fp, &stats);
+		stats.hits += cache->hits;
+		stats.misses += cache->misses;
+		stats.size += cache->stored;
+		if (stats.size > cache->limit) {
+			stats.size = cache_evict(cache->scratch, cache->dir, cache->limit);
+		}
+		stats_write(fp, &stats);
+		fclose(fp);
+	}
+	arena_free(&cache->scratch);
+}
+
+static void format_size(char *out, size_t size, long long bytes) {
+	if (bytes >= (1LL << 30)) {
+		snprintf(out, size, "%.1f GB", bytes / (double)(1LL << 30));
+	} else if (bytes >= (1LL << 20)) {
+		snprintf(out, size, "%.1f MB", bytes / (double)(1LL << 20));
+	} else {
+		snprintf(out, size, "%.1f KB", bytes / 1024.0);
+	}
+}
+
+/* `myBuild cache stats`, `myBuild cache clear` and `myBuild cache serve` */
+int cache_command(int argc, char *argv[]) {
+	Arena *arena = arena_init(BUFFER_SIZE);
+	String *dir = cache_dir_path(arena);
+	int ret = 1;
+	if (dir == NULL) {
+		fprintf(stderr, "Unable to locate the cache directory\n");
+		goto CLEANUP;
+	}
+
+	if (argc > 0 && strcmp(argv[0], "stats") == 0) {
+		Vector *files = vector_init(CacheFile);
+		long long size = 0;
+		int results = 0;
+		cache_list_files(arena, string(dir), files);
+		for (int i = 0; i < length(files); i++) {
+			CacheFile *file = &at(CacheFile, files, i);
+			size += file->size;
+			results += strstr(file->path + string_len(dir), "/r/") != NULL;
+		}
+		vector_free(files);
+
+		CacheStats stats = {0, 0, 0};
+		FILE *fp = directory_exists(string(dir))
+					   ? stats_open(arena, string(dir))
+					   : NULL;
+		if (fp != NULL) {
+			stats_read(fp, &stats);
+			fclose(fp);
+		}
+
+		char used[32], limit[32];
+		format_size(used, sizeof(used), size);
+		format_size(limit, sizeof(limit), cache_size_limit());
+		long lookups = stats.hits + stats.misses;
+		printf("Cache directory: %s\n", string(dir));
+		printf("Cached objects:  %d\n", results);
+		printf("Size:            %s of %s\n", used, limit);
+		printf("Hits:            %ld\n", stats.hits);
+		printf("Misses:          %ld\n", stats.misses);
+		printf("Hit rate:        %.1f%%\n",
+			   lookups ? 100.0 * stats.hits / lookups : 0.0);
+		ret = 0;
+	} else if (argc > 0 && strcmp(argv[0], "clear") == 0) {
+		FILE *fp = directory_exists(string(dir))
+					   ? stats_open(arena, string(dir))
+					   : NULL;
+		cache_evict(arena, string(dir), 0);
+		if (fp != NULL) {
+			CacheStats stats = {0, 0, 0};
+			stats_write(fp, &stats);
+			fclose(fp);
+		}
+		printf("[✓] Cleared '%s'\n", string(dir));
+		ret = 0;
+	} else if (argc > 0 && strcmp(argv[0], "serve") == 0) {
+		String *server_dir =
+			string_concat_cstr(arena, 2, string(dir), "/server");
+		if (make_dirs(string(server_dir)) == 0) {
+			ret = remote_cache_serve(string(server_dir), argc - 1, argv + 1);
+		}
+	} else {
+		printf("Usage: myBuild cache <stats|clear|serve>\n");
+	}
+
+CLEANUP:
+	arena_free(&arena);
+	return ret;
+}
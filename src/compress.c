@@ -0,0 +1,159 @@
+#include <mybuild.h>
+
+/*
+ * Compressor and decompressor for the LZ4 block format (lz4_Block_format.md
+ * in https://github.com/lz4/lz4), used for blobs sent to the remote cache.
+ * Greedy matching over a single hash table, objects are mostly zero padding,
+ * symbol tables and repeated relocations, so this already halves them.
+ * */
+
+#define LZ_HASH_BITS 16
+#define LZ_MIN_MATCH 4
+/* the last match must start 12 bytes before the end, the last 5 bytes are
+ * always literals */
+#define LZ_MF_LIMIT 12
+#define LZ_LAST_LITERALS 5
+#define LZ_MAX_OFFSET 65535
+
+static inline uint32_t lz_read32(const unsigned char *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t lz_hash(uint32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes the 255-runs that extend a length past its 4 bit field */
+static unsigned char *lz_put_length(unsigned char *op, size_t length) {
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char)length;
+	return op;
+}
+
+static unsigned char *lz_put_sequence(unsigned char *op,
+									  const unsigned char *literals,
+									  size_t literal_len, size_t offset,
+									  size_t match_len) {
+	unsigned char *token = op++;
+	*token = (unsigned char)((literal_len < 15 ? literal_len : 15) << 4);
+	if (literal_len >= 15) {
+		op = lz_put_length(op, literal_len - 15);
+	}
+	memcpy(op, literals, literal_len);
+	op += literal_len;
+	if (match_len == 0) {
+		return op;
+	}
+
+	*op++ = (unsigned char)(offset & 0xFF);
+	*op++ = (unsigned char)(offset >> 8);
+	match_len -= LZ_MIN_MATCH;
+	*token |= (unsigned char)(match_len < 15 ? match_len : 15);
+	if (match_len >= 15) {
+		op = lz_put_length(op, match_len - 15);
+	}
+	return op;
+}
+
+size_t lz_bound(size_t len) { return len + len / 255 + 16; }
+
+/* `dst` must hold lz_bound(len) bytes, returns the compressed size */
+size_t lz_compress(const char *src, size_t len, char *dst) {
+	const unsigned char *in = (const unsigned char *)src;
+	unsigned char *op = (unsigned char *)dst;
+	size_t anchor = 0;
+
+	if (len > LZ_MF_LIMIT) {
+		uint32_t *table =
+			(uint32_t *)calloc((size_t)1 << LZ_HASH_BITS, sizeof(uint32_t));
+		size_t limit = len - LZ_MF_LIMIT;
+		size_t ip = 0;
+		while (ip < limit) {
+			uint32_t sequence = lz_read32(in + ip);
+			uint32_t *slot = &table[lz_hash(sequence)];
+			size_t ref = *slot;
+			*slot = (uint32_t)ip;
+			if (ref >= ip || ip - ref > LZ_MAX_OFFSET ||
+				lz_read32(in + ref) != sequence) {
+				ip++;
+				continue;
+			}
+
+			size_t match_len = LZ_MIN_MATCH;
+			while (ip + match_len < len - LZ_LAST_LITERALS &&
+				   in[ref + match_len] == in[ip + match_len]) {
+				match_len++;
+			}
+			op = lz_put_sequence(op, in + anchor, ip - anchor, ip - ref,
+								 match_len);
+			ip += match_len;
+			anchor = ip;
+		}
+		free(table);
+	}
+
+	op = lz_put_sequence(op, in + anchor, len - anchor, 0, 0);
+	return op - (unsigned char *)dst;
+}
+
+static bool lz_get_length(const unsigned char **ip, const unsigned char *end,
+						  size_t *length) {
+	unsigned char byte;
+	do {
+		if (*ip >= end) {
+			return false;
+		}
+		byte = *(*ip)++;
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+/* Decompresses exactly `out_len` bytes, false on corrupt input */
+bool lz_decompress(const char *src, size_t len, char *dst, size_t out_len) {
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *end = ip + len;
+	unsigned char *out = (unsigned char *)dst;
+	size_t op = 0;
+
+	while (ip < end) {
+		unsigned char token = *ip++;
+		size_t literal_len = token >> 4;
+		if (literal_len == 15 && !lz_get_length(&ip, end, &literal_len)) {
+			return false;
+		}
+		if (literal_len > (size_t)(end - ip) || literal_len > out_len - op) {
+			return false;
+		}
+		memcpy(out + op, ip, literal_len);
+		ip += literal_len;
+		op += literal_len;
+		if (ip == end) {
+			break;
+		}
+
+		if (end - ip < 2) {
+			return false;
+		}
+		size_t offset = ip[0] | (size_t)ip[1] << 8;
+		ip += 2;
+		size_t match_len = token & 15;
+		if (match_len == 15 && !lz_get_length(&ip, end, &match_len)) {
+			return false;
+		}
+		match_len += LZ_MIN_MATCH;
+		if (offset == 0 || offset > op || match_len > out_len - op) {
+			return false;
+		}
+		/* byte by byte, the match may overlap what it produces */
+		for (size_t i = 0; i < match_len; i++, op++) {
+			out[op] = out[op - offset];
+		}
+	}
+	return op == out_len;
+}
@@ -57,106 +57,55 @@ CLEANUP:
 
 int generate_compile_commands() {
 	Arena *str_arena = arena_init(1024);
-	char *input_file = "myBuild.json";
 	char *output_file = "compile_commands.json";
 	int success = 1;
+	/* include directories and sources that are the same path once
+	 * normalized are only listed once */
+	PathIndex seen = {NULL, 0};
 
-	yyjson_read_err err;
-	yyjson_doc *doc = yyjson_read_file(input_file, 0, NULL, &err);
-
-	if (!doc) {
-		fprintf(stderr, "Failed to read %s: %s\n", input_file, err.msg);
-		// return -1;
+	ProjectModel *model = project_model_load(str_arena);
+	if (model == NULL) {
 		success = 0;
 		goto CLEANUP;
 	}
 
-	yyjson_val *root = yyjson_doc_get_root(doc);
-
-	yyjson_val *compiler_val = yyjson_obj_get(root, "compiler_path");
-	const char *compiler = yyjson_get_str(compiler_val);
-	String *cwd = get_current_working_dir(str_arena);
-
-	Vector *include_paths = vector_init(char *);
-
-	yyjson_val *inc_arr = yyjson_obj_get(root, "include_paths");
-	if (yyjson_is_arr(inc_arr)) {
-		yyjson_arr_iter iter;
-		success = yyjson_arr_iter_init(inc_arr, &iter);
-		if (!success) {
-			fprintf(stderr, "Non an iterator: include_paths\n");
-			success = 0;
-			vector_free(include_paths);
-			goto CLEANUP;
-		}
-		yyjson_val *val;
-		while ((val = yyjson_arr_iter_next(&iter))) {
-			append(char *, include_paths,
-				   string(string_concat_cstr(str_arena, 3, string(cwd), "/",
-											 (char *)yyjson_get_str(val))));
-		}
-	}
-
-	yyjson_val *deps = yyjson_obj_get(root, "dependencies");
-	if (yyjson_is_obj(deps)) {
-		yyjson_obj_iter iter;
-		success = yyjson_obj_iter_init(deps, &iter);
-		if (!success) {
-			fprintf(stderr, "Non an iterator: deps\n");
-			success = 0;
-			vector_free(include_paths);
-			goto CLEANUP;
-		}
-		yyjson_val *key, *dep_obj;
-		while ((key = yyjson_obj_iter_next(&iter))) {
-			dep_obj = yyjson_obj_iter_get_val(key);
-			const char *dep_name = yyjson_get_str(key);
-
-			yyjson_val *dep_inc = yyjson_obj_get(dep_obj, "include_paths");
-			if (yyjson_is_arr(dep_inc)) {
-				yyjson_arr_iter inc_iter;
-				success = yyjson_arr_iter_init(dep_inc, &inc_iter);
-				if (!success) {
-					fprintf(stderr, "Non an iterator: deps_include_paths\n");
-					success = 0;
-					vector_free(include_paths);
-					goto CLEANUP;
-				}
-				yyjson_val *inc_val;
-				while ((inc_val = yyjson_arr_iter_next(&inc_iter))) {
-					String *path = string_concat_cstr(
-						str_arena, 5, string(cwd), "/deps/", (char *)dep_name,
-						"/", (char *)yyjson_get_str(inc_val));
-					append(char *, include_paths, string(path));
-				}
-			}
-		}
-	}
-
-	Vector *source_files = vector_init(char *);
-	get_src_vec(str_arena, source_files, root, deps, cwd);
+	char *cwd = model->cwd;
+	Vector *source_files = model->sources;
 
 	yyjson_mut_doc *out_doc = yyjson_mut_doc_new(NULL);
 	yyjson_mut_val *out_root = yyjson_mut_arr(out_doc);
 	yyjson_mut_doc_set_root(out_doc, out_root);
 
-	String *includes = string_from(str_arena, "");
-	for (size_t i = 0; i < length(include_paths); i++) {
-		includes = string_concat_cstr(str_arena, 3, string(includes), " -I",
-									  at(char *, include_paths, i));
+	StringBuilder sb;
+	string_builder_init(&sb, BUFFER_SIZE);
+	for (int i = 0; i < length(model->include_dirs); i++) {
+		PathId dir = path_intern(string(string_concat_cstr(
+			str_arena, 3, cwd, "/", at(char *, model->include_dirs, i))));
+		if (path_index_get(&seen, dir) >= 0) {
+			continue;
+		}
+		path_index_put(&seen, dir, i);
+		string_builder_append(&sb, " -I");
+		string_builder_append(&sb, path_str(dir));
 	}
+	String *includes = string_builder_finish(str_arena, &sb);
+
+	size_t entry_count = 0;
+	for (int i = 0; i < length(source_files); i++) {
+		PathId source = path_intern(at(char *, source_files, i));
+		if (path_index_get(&seen, source) >= 0) {
+			continue;
+		}
+		path_index_put(&seen, source, i);
+		entry_count++;
 
-	for (size_t i = 0; i < length(source_files); i++) {
 		yyjson_mut_val *entry = yyjson_mut_arr_add_obj(out_doc, out_root);
 
-		success =
-			yyjson_mut_obj_add_str(out_doc, entry, "directory", string(cwd));
+		success = yyjson_mut_obj_add_str(out_doc, entry, "directory", cwd);
 		if (!success) {
 			fprintf(stderr,
 					"Error encountered while generating compile commands\n");
 			success = 0;
-			vector_free(include_paths);
-			vector_free(source_files);
 			yyjson_mut_doc_free(out_doc);
 			goto CLEANUP;
 		}
@@ -166,15 +115,12 @@ int generate_compile_commands() {
 			fprintf(stderr,
 					"Error encountered while generating compile commands\n");
 			success = 0;
-			vector_free(include_paths);
-			vector_free(source_files);
 			yyjson_mut_doc_free(out_doc);
 			goto CLEANUP;
 		}
 
-		String *command = string_from(str_arena, "");
-		command = string_concat_cstr(
-			str_arena, 7, (char *)compiler, " -c ", at(char *, source_files, i),
+		String *command = string_concat_cstr(
+			str_arena, 7, model->compiler, " -c ", at(char *, source_files, i),
 			string(includes), " -o ", at(char *, source_files, i), ".o");
 
 		success =
@@ -183,8 +129,6 @@ int generate_compile_commands() {
 			fprintf(stderr,
 					"Error encountered while generating compile commands\n");
 			success = 0;
-			vector_free(include_paths);
-			vector_free(source_files);
 			yyjson_mut_doc_free(out_doc);
 			goto CLEANUP;
 		}
@@ -198,16 +142,18 @@ int generate_compile_commands() {
 	if (!success) {
 		fprintf(stderr, "Failed to write %s: %s\n", output_file, write_err.msg);
 	} else {
-		printf("Generated %s with %d source files\n", output_file,
-			   length(source_files));
+		printf("Generated %s with %zu source files\n", output_file,
+			   entry_count);
 	}
 
-	vector_free(include_paths);
-	vector_free(source_files);
 	yyjson_mut_doc_free(out_doc);
 
 CLEANUP:
-	yyjson_doc_free(doc);
+	path_index_free(&seen);
+	if (model != NULL) {
+		project_model_free(model);
+	}
+	path_table_free();
 	arena_free(&str_arena);
 
 	return success ? 0 : -1;
@@ -222,35 +168,6 @@ bool is_mybuild_config_present(char *filename) {
 	return false;
 }
 
-String *get_flags(Arena *str_arena, yyjson_val *root, String *type) {
-	Arena *local_arena = arena_init(1024);
-	String *flag_list = string_from(local_arena, "");
-
-	yyjson_val *flag_arr;
-
-	if (STR_CMP(string(type), "build") == 0) {
-		flag_arr = yyjson_obj_get(root, "flags");
-	} else if (STR_CMP(string(type), "lib") == 0) {
-		flag_arr = yyjson_obj_get(root, "lib_links");
-	}
-
-	size_t idx = 0, max = 0;
-	yyjson_val *val;
-
-	yyjson_arr_foreach(flag_arr, idx, max, val) {
-		if (string_len(flag_list) == 0) {
-			flag_list = string_from(local_arena, (char *)yyjson_get_str(val));
-		} else {
-			flag_list = string_concat_cstr(local_arena, 3, string(flag_list),
-										   "\n", (char *)yyjson_get_str(val));
-		}
-	}
-
-	String *export_list = string_from(str_arena, string(flag_list));
-	arena_free(&local_arena);
-	return export_list;
-}
-
 void _add_local(int lib_count, char **lib_link, char *element) {
 
 	Arena *arena = arena_init(1024);
@@ -276,7 +193,7 @@ void _add_local(int lib_count, char **lib_link, char *element) {
 	yyjson_mut_val *root = yyjson_mut_doc_get_root(mut_doc);
 	yyjson_mut_val *local_elem = yyjson_mut_obj_get(root, element);
 
-	Vector *temp_vec = vector_init(char *);
+	HashSet *temp_vec = string_set_init();
 
 	int idx = 0, max = 0;
 	yyjson_mut_val *val_mut;
@@ -291,8 +208,9 @@ void _add_local(int lib_count, char **lib_link, char *element) {
 	}
 
 	yyjson_mut_arr_clear(local_elem);
-	for (int i = 0; i < length(temp_vec); i++) {
-		yyjson_mut_arr_add_str(mut_doc, local_elem, at(char *, temp_vec, i));
+	for (int i = 0; i < hashset_size(temp_vec); i++) {
+		yyjson_mut_arr_add_str(mut_doc, local_elem,
+							   (char *)hashset_at(temp_vec, i));
 	}
 
 	yyjson_write_err werr;
@@ -301,7 +219,7 @@ void _add_local(int lib_count, char **lib_link, char *element) {
 		fprintf(stderr, "Write error: %s\n", werr.msg);
 	}
 
-	vector_free(temp_vec);
+	hashset_free(temp_vec);
 	yyjson_mut_doc_free(mut_doc);
 	arena_free(&arena);
 }
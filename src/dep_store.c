@@ -0,0 +1,379 @@
+/* nftw's FTW_PHYS is an XSI extension */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <mybuild.h>
+
+#include <ftw.h>
+#include <time.h>
+
+/*
+ * Store of built dependencies shared by every project on the machine. An
+ * entry `<name>-<version>-<key>-<inputs>` holds the dependency's archive and
+ * the digest of every file under `deps/` its objects were compiled from. The
+ * key covers the compiler, the flags and the list of sources, `<inputs>` is
+ * the hash of those digests, so differently patched copies of a dependency
+ * get entries of their own.
+ *
+ * The store saves compiling, not fetching: before an entry is used the
+ * project's own copies of its inputs are compared with the recorded digests,
+ * and the project still compiles against its own headers.
+ *
+ * Every project records the entries its last build used under `refs`,
+ * `myBuild store gc` removes the entries no existing project refers to.
+ * */
+
+/* v2 entries list system headers too, older ones never match */
+#define STORE_INPUTS_HEADER "# myBuild store entry v2"
+#define STORE_TMP_PREFIX ".tmp-"
+
+struct DepStore {
+	Arena *arena;
+	char *dir;
+	char *cwd;
+	/* entries this build used */
+	Vector *used;
+};
+
+/* $MYBUILD_STORE_DIR, or myBuild/store under $XDG_DATA_HOME or
+ * ~/.local/share */
+static String *store_dir_path(Arena *arena) {
+	char *dir = getenv("MYBUILD_STORE_DIR");
+	if (dir != NULL && dir[0] != '\0') {
+		return string_from(arena, dir);
+	}
+	dir = getenv("XDG_DATA_HOME");
+	if (dir != NULL && dir[0] == '/') {
+		return string_concat_cstr(arena, 2, dir, "/myBuild/store");
+	}
+	dir = getenv("HOME");
+	if (dir != NULL && dir[0] != '\0') {
+		return string_concat_cstr(arena, 2, dir, "/.local/share/myBuild/store");
+	}
+	return NULL;
+}
+
+DepStore *dep_store_open(Arena *arena, char *cwd) {
+	String *dir = store_dir_path(arena);
+	if (dir == NULL || make_dirs(string(dir))) {
+		return NULL;
+	}
+
+	DepStore *store = (DepStore *)arena_alloc(arena, sizeof(*store));
+	store->arena = arena;
+	store->dir = string(dir);
+	store->cwd = cwd;
+	store->used = vector_init(char *);
+	return store;
+}
+
+uint64_t dep_store_key(DepStore *store, String *compiler_identity,
+					   String *response, Vector *sources) {
+	uint64_t hash = hash_string(string(compiler_identity), 0);
+	hash = hash_string(string(response), hash);
+	/* relative to the project, the same in every project */
+	for (int i = 0; i < length(sources); i++) {
+		hash = hash_string(
+			path_relative_to(at(char *, sources, i), store->cwd), hash);
+	}
+	return hash;
+}
+
+/* `<name>-<version>-<key>-`, what every entry of that build starts with */
+static char *store_entry_prefix(DepStore *store, const char *name,
+								const char *version, uint64_t key) {
+	char entry[BUFFER_SIZE];
+	snprintf(entry, sizeof(entry), "%s-%s-%016llx-", name,
+			 version[0] != '\0' ? version : "0", (unsigned long long)key);
+	for (char *c = entry; *c != '\0'; c++) {
+		if (*c == '/') {
+			*c = '_';
+		}
+	}
+	return string(string_from(store->arena, entry));
+}
+
+/* Whether every recorded input still has its digest */
+static bool store_inputs_match(BuildLog *log, const char *inputs) {
+	FILE *in = fopen(inputs, "r");
+	if (in == NULL) {
+		return false;
+	}
+
+	char line[BUFFER_SIZE];
+	bool match = fgets(line, sizeof(line), in) != NULL &&
+				 strncmp(line, STORE_INPUTS_HEADER,
+						 strlen(STORE_INPUTS_HEADER)) == 0;
+	while (match && fgets(line, sizeof(line), in) != NULL) {
+		unsigned long long recorded;
+		uint64_t digest;
+		int offset;
+		line[strcspn(line, "\n")] = '\0';
+		match = sscanf(line, "%16llx\t%n", &recorded, &offset) == 1 &&
+				build_log_file_digest(log, path_intern(line + offset),
+									  &digest) &&
+				digest == recorded;
+	}
+	fclose(in);
+	return match;
+}
+
+/* The archive of an entry whose inputs match the project's files, NULL when
+ * there's none */
+char *dep_store_lookup(DepStore *store, BuildLog *log, const char *name,
+					   const char *version, uint64_t key) {
+	char *prefix = store_entry_prefix(store, name, version, key);
+	size_t prefix_len = strlen(prefix);
+	char *found = NULL;
+	DIR *store_dir = opendir(store->dir);
+	struct dirent *entry;
+	while (found == NULL && store_dir != NULL &&
+		   (entry = readdir(store_dir)) != NULL) {
+		if (strncmp(entry->d_name, prefix, prefix_len) != 0) {
+			continue;
+		}
+		String *dir = string_concat_cstr(store->arena, 3, store->dir, "/",
+										 entry->d_name);
+		String *inputs =
+			string_concat_cstr(store->arena, 2, string(dir), "/inputs");
+		String *archive = string_concat_cstr(store->arena, 4, string(dir),
+											 "/lib", (char *)name, ".a");
+		if (file_exists(string(archive)) &&
+			store_inputs_match(log, string(inputs))) {
+			append(char *, store->used,
+				   string(string_from(store->arena, entry->d_name)));
+			found = string(archive);
+		}
+	}
+	if (store_dir != NULL) {
+		closedir(store_dir);
+	}
+	return found;
+}
+
+static int remove_entry(const char *path, const struct stat *attr, int flag,
+						struct FTW *ftw) {
+	(void)attr;
+	(void)flag;
+	(void)ftw;
+	remove(path);
+	return 0;
+}
+
+static void remove_tree(const char *path) {
+	nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+/* Adds a dependency built by this project. `objects` are its archive's
+ * members, their inputs come from the deps log. Entries are never replaced,
+ * other builds may be linking them, an existing one is the same build.
+ * Returns the stored archive, NULL when it couldn't be stored */
+char *dep_store_publish(DepStore *store, BuildLog *log, DepsLog *deps_log,
+						const char *name, const char *version, uint64_t key,
+						const char *archive, Vector *objects) {
+	char *stored = NULL;
+	/* system headers too, an upgraded library must not match old entries */
+	int input_count = 0;
+	HashSet *seen = hashset_init();
+	StringBuilder sb;
+	string_builder_init(&sb, BUFFER_SIZE);
+	string_builder_append(&sb, STORE_INPUTS_HEADER "\n");
+	bool complete = true;
+	for (int i = 0; i < length(objects) && complete; i++) {
+		PathId *deps;
+		int count = deps_log_lookup(deps_log,
+									path_intern(at(char *, objects, i)), &deps);
+		complete = count >= 0;
+		for (int j = 0; j < count && complete; j++) {
+			char *input =
+				(char *)path_relative_to(path_str(deps[j]), store->cwd);
+			uint64_t digest;
+			char line[40];
+			if (hashset_contains(seen, input)) {
+				continue;
+			}
+			complete = build_log_file_digest(log, deps[j], &digest);
+			snprintf(line, sizeof(line), "%016llx\t",
+					 (unsigned long long)digest);
+			string_builder_append(&sb, line);
+			string_builder_append(&sb, input);
+			string_builder_append_char(&sb, '\n');
+			hashset_add(seen, input);
+			input_count++;
+		}
+	}
+	String *content = string_builder_finish(store->arena, &sb);
+
+	char entry[BUFFER_SIZE];
+	snprintf(entry, sizeof(entry), "%s%016llx",
+			 store_entry_prefix(store, name, version, key),
+			 (unsigned long long)hash_string(string(content), 0));
+	String *dir = string_concat_cstr(store->arena, 3, store->dir, "/", entry);
+	char tmp[BUFFER_SIZE * 2], path[BUFFER_SIZE * 3];
+	snprintf(tmp, sizeof(tmp), "%s/" STORE_TMP_PREFIX "%s.%d", store->dir,
+			 entry, (int)getpid());
+	if (!complete || input_count == 0) {
+		goto CLEANUP;
+	}
+
+	/* built next to the entry, then renamed so it appears complete */
+	if (!directory_exists(string(dir)) && make_dirs(tmp) == 0) {
+		snprintf(path, sizeof(path), "%s/lib%s.a", tmp, name);
+		int err = copy_file(archive, path);
+		snprintf(path, sizeof(path), "%s/inputs", tmp);
+		err = err || create_append_file(path, string(content));
+		if (!err && rename(tmp, string(dir)) == 0) {
+			printf("[✓] Stored '%s'\n", entry);
+		}
+	}
+	/* also when another build published it first */
+	if (directory_exists(string(dir))) {
+		append(char *, store->used, string(string_from(store->arena, entry)));
+		stored = string(string_concat_cstr(store->arena, 4, string(dir),
+										   "/lib", (char *)name, ".a"));
+	}
+
+CLEANUP:
+	if (directory_exists(tmp)) {
+		remove_tree(tmp);
+	}
+	hashset_free(seen);
+	return stored;
+}
+
+/* Records the entries this build used, so gc keeps them */
+void dep_store_close(DepStore *store) {
+	/* room for the hash, and for the temporary's suffix below */
+	char refs[BUFFER_SIZE], path[BUFFER_SIZE + 32];
+	snprintf(refs, sizeof(refs), "%s/refs", store->dir);
+	snprintf(path, sizeof(path), "%s/%016llx", refs,
+			 (unsigned long long)hash_string(store->cwd, 0));
+
+	if (length(store->used) == 0) {
+		unlink(path);
+	} else if (make_dirs(refs) == 0) {
+		StringBuilder sb;
+		string_builder_init(&sb, BUFFER_SIZE);
+		string_builder_append(&sb, store->cwd);
+		for (int i = 0; i < length(store->used); i++) {
+			string_builder_append_char(&sb, '\n');
+			string_builder_append(&sb, at(char *, store->used, i));
+		}
+		string_builder_append_char(&sb, '\n');
+		String *content = string_builder_finish(store->arena, &sb);
+
+		char tmp[sizeof(path) + 32];
+		snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+		if (create_append_file(tmp, string(content)) ||
+			rename(tmp, path) != 0) {
+			unlink(tmp);
+		}
+	}
+	vector_free(store->used);
+}
+
+static long long tree_size;
+
+static int add_size(const char *path, const struct stat *attr, int flag,
+					struct FTW *ftw) {
+	(void)path;
+	(void)ftw;
+	if (flag == FTW_F) {
+		tree_size += attr->st_size;
+	}
+	return 0;
+}
+
+/* Collects the entries referred to by projects that still exist, dropping
+ * the references of the others */
+static void store_referenced(Arena *arena, const char *dir, HashSet *live) {
+	char refs[BUFFER_SIZE];
+	snprintf(refs, sizeof(refs), "%s/refs", dir);
+	DIR *refs_dir = opendir(refs);
+	struct dirent *ref;
+	while (refs_dir != NULL && (ref = readdir(refs_dir)) != NULL) {
+		char path[BUFFER_SIZE * 2], line[BUFFER_SIZE];
+		snprintf(path, sizeof(path), "%s/%s", refs, ref->d_name);
+		FILE *in = ref->d_name[0] != '.' ? fopen(path, "r") : NULL;
+		if (in == NULL) {
+			continue;
+		}
+
+		bool exists = false;
+		if (fgets(line, sizeof(line), in) != NULL) {
+			line[strcspn(line, "\n")] = '\0';
+			String *manifest =
+				string_concat_cstr(arena, 2, line, "/" PROJECT_MANIFEST);
+			exists = file_exists(string(manifest));
+		}
+		while (exists && fgets(line, sizeof(line), in) != NULL) {
+			line[strcspn(line, "\n")] = '\0';
+			hashset_add(live, string(string_from(arena, line)));
+		}
+		fclose(in);
+		if (!exists) {
+			unlink(path);
+		}
+	}
+	if (refs_dir != NULL) {
+		closedir(refs_dir);
+	}
+}
+
+/* `myBuild store gc`, removes entries no project refers to anymore, and
+ * leftovers of interrupted builds */
+int store_command(int argc, char *argv[]) {
+	if (argc < 1 || strcmp(argv[0], "gc") != 0) {
+		printf("Usage: myBuild store gc\n");
+		return 1;
+	}
+
+	Arena *arena = arena_init(BUFFER_SIZE);
+	String *dir = store_dir_path(arena);
+	if (dir == NULL || !directory_exists(string(dir))) {
+		printf("[✓] Store is empty\n");
+		arena_free(&arena);
+		return 0;
+	}
+
+	HashSet *live = hashset_init();
+	store_referenced(arena, string(dir), live);
+
+	int removed = 0;
+	long long freed = 0;
+	long long stale = (long long)time(NULL) - 24 * 60 * 60;
+	DIR *store_dir = opendir(string(dir));
+	struct dirent *entry;
+	while (store_dir != NULL && (entry = readdir(store_dir)) != NULL) {
+		char path[BUFFER_SIZE * 2];
+		struct stat attr;
+		snprintf(path, sizeof(path), "%s/%s", string(dir), entry->d_name);
+		bool tmp = strncmp(entry->d_name, STORE_TMP_PREFIX,
+						   strlen(STORE_TMP_PREFIX)) == 0;
+		if ((!tmp && entry->d_name[0] == '.') ||
+			strcmp(entry->d_name, "refs") == 0 || lstat(path, &attr) != 0 ||
+			!S_ISDIR(attr.st_mode) ||
+			(tmp && (long long)attr.st_mtime > stale) ||
+			(!tmp && hashset_contains(live, entry->d_name))) {
+			continue;
+		}
+		tree_size = 0;
+		nftw(path, add_size, 16, FTW_PHYS);
+		remove_tree(path);
+		freed += tree_size;
+		removed += !tmp;
+		if (!tmp) {
+			printf("[✓] Removed '%s'\n", entry->d_name);
+		}
+	}
+	if (store_dir != NULL) {
+		closedir(store_dir);
+	}
+
+	printf("[✓] Removed %d entries, freed %.1f MB\n", removed,
+		   freed / (double)(1 << 20));
+	hashset_free(live);
+	arena_free(&arena);
+	return 0;
+}
@@ -0,0 +1,355 @@
+#include <mybuild.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/*
+ * Binary dependency log, in the spirit of ninja's `.ninja_deps`.
+ *
+ * The file is a 16 byte header followed by append-only records, each made of
+ * a RecordHeader and a payload padded to 4 bytes:
+ *
+ *   path record: the NUL terminated path, its ID is the number of path
+ *                records before it
+ *   deps record: the object's path ID followed by the IDs of its inputs
+ *
+ * A newer deps record for the same object replaces the older one. The file is
+ * memory mapped on open, its paths are interned and the record IDs, which are
+ * local to the file, are translated to PathIds.
+ * */
+
+#define DEPS_LOG_MAGIC "MBDEPS\0\0"
+#define DEPS_LOG_VERSION 1
+#define DEPS_RECORD_PATH 1
+#define DEPS_RECORD_DEPS 2
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+} DepsLogHeader;
+
+typedef struct {
+	uint32_t type;
+	uint32_t size;
+} RecordHeader;
+
+typedef struct {
+	PathId path;
+	/* inputs of this node when it is an object, NULL otherwise */
+	PathId *deps;
+	uint32_t dep_count;
+} DepsNode;
+
+struct DepsLog {
+	Arena *arena;
+	/* `.d` file contents, rewound after every ingest */
+	Arena *scratch;
+	char *path;
+	FILE *out;
+	/* indexed by the IDs used in the file */
+	Vector *nodes;
+	/* PathId -> ID in the file */
+	PathIndex index;
+	int dead_records;
+};
+
+static int deps_log_add_node(DepsLog *log, PathId path) {
+	DepsNode node;
+	node.path = path;
+	node.deps = NULL;
+	node.dep_count = 0;
+	append(DepsNode, log->nodes, node);
+
+	int id = length(log->nodes) - 1;
+	path_index_put(&log->index, path, id);
+	return id;
+}
+
+static int write_record(FILE *out, uint32_t type, const void *payload,
+						uint32_t size) {
+	static const char padding[4] = {0, 0, 0, 0};
+	uint32_t padded = (size + 3) & ~3u;
+	RecordHeader header = {type, padded};
+
+	if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+		fwrite(payload, 1, size, out) != size ||
+		fwrite(padding, 1, padded - size, out) != padded - size) {
+		return 1;
+	}
+	return 0;
+}
+
+/* Translates the IDs of a deps record to PathIds, false when one of them is
+ * unknown */
+static bool deps_log_translate(DepsLog *log, DepsNode *node, uint32_t *ids,
+							   uint32_t count) {
+	PathId *deps = (PathId *)arena_alloc(log->arena, sizeof(PathId) * count);
+	for (uint32_t i = 0; i < count; i++) {
+		if (ids[i] >= (uint32_t)length(log->nodes)) {
+			return false;
+		}
+		deps[i] = at(DepsNode, log->nodes, ids[i]).path;
+	}
+	if (node->deps != NULL) {
+		log->dead_records++;
+	}
+	node->deps = deps;
+	node->dep_count = count;
+	return true;
+}
+
+/* Parses the mapped file, returns the length of the valid prefix */
+static size_t deps_log_parse(DepsLog *log, char *data, size_t data_len) {
+	size_t pos = sizeof(DepsLogHeader);
+
+	while (pos + sizeof(RecordHeader) <= data_len) {
+		RecordHeader *header = (RecordHeader *)(data + pos);
+		char *payload = data + pos + sizeof(RecordHeader);
+
+		if (header->size % 4 != 0 ||
+			header->size > data_len - pos - sizeof(RecordHeader)) {
+			break;
+		}
+
+		if (header->type == DEPS_RECORD_PATH) {
+			if (header->size == 0 || payload[header->size - 1] != '\0') {
+				break;
+			}
+			deps_log_add_node(log, path_intern(payload));
+		} else if (header->type == DEPS_RECORD_DEPS) {
+			uint32_t *ids = (uint32_t *)payload;
+			uint32_t count = header->size / 4;
+			if (count == 0 || ids[0] >= (uint32_t)length(log->nodes)) {
+				break;
+			}
+			/* paths equal after normalization share the latest node */
+			PathId object = at(DepsNode, log->nodes, ids[0]).path;
+			DepsNode *node = &at(DepsNode, log->nodes,
+								 path_index_get(&log->index, object));
+			if (!deps_log_translate(log, node, ids + 1, count - 1)) {
+				break;
+			}
+		} else {
+			break;
+		}
+
+		pos += sizeof(RecordHeader) + header->size;
+	}
+	return pos;
+}
+
+static FILE *deps_log_create(const char *path) {
+	FILE *out = fopen(path, "wb");
+	if (out == NULL) {
+		return NULL;
+	}
+	DepsLogHeader header;
+	memcpy(header.magic, DEPS_LOG_MAGIC, sizeof(header.magic));
+	header.version = DEPS_LOG_VERSION;
+	header.reserved = 0;
+	fwrite(&header, sizeof(header), 1, out);
+	return out;
+}
+
+DepsLog *deps_log_open(Arena *arena, const char *path) {
+	DepsLog *log = (DepsLog *)arena_alloc(arena, sizeof(DepsLog));
+	log->arena = arena;
+	log->scratch = arena_init(BUFFER_SIZE);
+	log->path = string(string_from(arena, (char *)path));
+	log->out = NULL;
+	log->nodes = vector_init(DepsNode);
+	log->index = (PathIndex){NULL, 0};
+	log->dead_records = 0;
+
+	void *map = NULL;
+	size_t map_len = 0;
+	int fd = open(path, O_RDONLY);
+	if (fd >= 0) {
+		struct stat attr;
+		if (fstat(fd, &attr) == 0 &&
+			(size_t)attr.st_size >= sizeof(DepsLogHeader)) {
+			map_len = attr.st_size;
+			map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (map == MAP_FAILED) {
+				map = NULL;
+			}
+		}
+		close(fd);
+	}
+
+	size_t valid_len = 0;
+	if (map != NULL) {
+		DepsLogHeader *header = (DepsLogHeader *)map;
+		if (memcmp(header->magic, DEPS_LOG_MAGIC, sizeof(header->magic)) ==
+				0 &&
+			header->version == DEPS_LOG_VERSION) {
+			valid_len = deps_log_parse(log, (char *)map, map_len);
+		}
+		munmap(map, map_len);
+	}
+
+	if (valid_len == 0) {
+		/* missing, unknown version or corrupted header, start over */
+		log->out = deps_log_create(path);
+	} else {
+		if (valid_len < map_len && truncate(path, valid_len) != 0) {
+			perror("Unable to repair deps log");
+		}
+		log->out = fopen(path, "ab");
+	}
+
+	if (log->out == NULL) {
+		perror("Unable to open deps log");
+	}
+	return log;
+}
+
+/* Returns the number of inputs recorded for the object and points `deps` at
+ * them, -1 when the object has no record */
+int deps_log_lookup(DepsLog *log, PathId object, PathId **deps) {
+	int id = path_index_get(&log->index, object);
+	if (id < 0) {
+		return -1;
+	}
+	DepsNode *node = &at(DepsNode, log->nodes, id);
+	if (node->deps == NULL) {
+		return -1;
+	}
+	*deps = node->deps;
+	return (int)node->dep_count;
+}
+
+/* Returns the ID of the path in the file, writing a path record for paths
+ * seen for the first time */
+static int deps_log_intern(DepsLog *log, PathId path) {
+	int id = path_index_get(&log->index, path);
+	if (id >= 0) {
+		return id;
+	}
+	char *str = path_str(path);
+	if (write_record(log->out, DEPS_RECORD_PATH, str, strlen(str) + 1)) {
+		return -1;
+	}
+	return deps_log_add_node(log, path);
+}
+
+int deps_log_record(DepsLog *log, PathId object, Vector *deps) {
+	/* the log couldn't be opened for writing, paths read from it are
+	 * interned already and wouldn't notice */
+	if (log->out == NULL) {
+		return 1;
+	}
+	int count = length(deps);
+	uint32_t *ids =
+		(uint32_t *)arena_alloc(log->arena, sizeof(uint32_t) * (count + 1));
+
+	int object_id = deps_log_intern(log, object);
+	if (object_id < 0) {
+		return 1;
+	}
+	ids[0] = object_id;
+	for (int i = 0; i < count; i++) {
+		int id = deps_log_intern(log, path_intern(at(char *, deps, i)));
+		if (id < 0) {
+			return 1;
+		}
+		ids[i + 1] = id;
+	}
+
+	if (write_record(log->out, DEPS_RECORD_DEPS, ids,
+					 sizeof(uint32_t) * (count + 1))) {
+		return 1;
+	}
+
+	deps_log_translate(log, &at(DepsNode, log->nodes, object_id), ids + 1,
+					   count);
+	return 0;
+}
+
+/* Moves the dependencies listed in a compiler generated `.d` file into the
+ * log and removes the `.d` file */
+int deps_log_ingest(DepsLog *log, PathId object, const char *d_file) {
+	ArenaMark mark = arena_mark(log->scratch);
+	Vector *deps = read_dep_file(log->scratch, d_file);
+	if (deps == NULL) {
+		return 1;
+	}
+	int err = deps_log_record(log, object, deps);
+	vector_free(deps);
+	arena_rewind(log->scratch, mark);
+	if (!err) {
+		unlink(d_file);
+	}
+	return err;
+}
+
+/* True when an input of the object is newer than `obj_time`, or when nothing
+ * is known about the object's inputs */
+bool deps_log_newer_than(DepsLog *log, PathId object, long long obj_time) {
+	PathId *deps;
+	int count = deps_log_lookup(log, object, &deps);
+	if (count < 0) {
+		return true;
+	}
+	for (int i = 0; i < count; i++) {
+		if (stat_cache_mtime(deps[i]) > obj_time) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Rewrites the log with only the latest deps record of every object */
+static void deps_log_recompact(DepsLog *log) {
+	String *tmp_path = string_concat_cstr(log->arena, 2, log->path, ".tmp");
+	FILE *out = deps_log_create(string(tmp_path));
+	if (out == NULL) {
+		return;
+	}
+
+	int err = 0;
+	for (int i = 0; i < length(log->nodes) && !err; i++) {
+		char *path = path_str(at(DepsNode, log->nodes, i).path);
+		err = write_record(out, DEPS_RECORD_PATH, path, strlen(path) + 1);
+	}
+	for (int i = 0; i < length(log->nodes) && !err; i++) {
+		DepsNode *node = &at(DepsNode, log->nodes, i);
+		if (node->deps == NULL) {
+			continue;
+		}
+		uint32_t *ids = (uint32_t *)arena_alloc(
+			log->scratch, sizeof(uint32_t) * (node->dep_count + 1));
+		ids[0] = i;
+		for (uint32_t j = 0; j < node->dep_count; j++) {
+			ids[j + 1] = path_index_get(&log->index, node->deps[j]);
+		}
+		err = write_record(out, DEPS_RECORD_DEPS, ids,
+						   sizeof(uint32_t) * (node->dep_count + 1));
+	}
+
+	if (fclose(out) != 0 || err || rename(string(tmp_path), log->path) != 0) {
+		unlink(string(tmp_path));
+	}
+}
+
+void deps_log_close(DepsLog *log) {
+	int live = 0;
+	for (int i = 0; i < length(log->nodes); i++) {
+		if (at(DepsNode, log->nodes, i).deps != NULL) {
+			live++;
+		}
+	}
+
+	if (log->out != NULL) {
+		fclose(log->out);
+		log->out = NULL;
+	}
+	if (log->dead_records > 1000 && log->dead_records > live * 3) {
+		deps_log_recompact(log);
+	}
+
+	vector_free(log->nodes);
+	path_index_free(&log->index);
+	arena_free(&log->scratch);
+}
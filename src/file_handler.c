@@ -11,204 +11,237 @@ int create_append_file(char *file_path, char *content) {
 	return 0;
 }
 
-String *collect_files(Arena *str_arena, String *path, String *type) {
-	String *src_files = string_from(str_arena, "");
-	String *ext_1 = string_from(str_arena, ".c");
-	String *ext_2 = string_from(str_arena, ".cpp");
-
-	char sep[2] = {'\n', '\0'};
-
-	if (STR_CMP(string(type), "static") == 0) {
-		sep[0] = ' ';
-		ext_1 = string_from(str_arena, ".a");
-		ext_2 = string_from(str_arena, ".lib");
-	} else if (STR_CMP(string(type), "dyn") == 0) {
-		sep[0] = ' ';
-		ext_1 = string_from(str_arena, ".so");
-		ext_2 = string_from(str_arena, ".dll");
-	} else if (STR_CMP(string(type), "header") == 0) {
-		sep[0] = '\n';
-		ext_1 = string_from(str_arena, ".h");
-		ext_2 = string_from(str_arena, ".hpp");
-	}
-
-	DIR *dir;
-	struct dirent *entry;
-
-	dir = opendir(string(path));
-
-	// if (dir == NULL) {
-	// 	perror("Unable to open directory");
-	// 	return NULL;
-	// }
+void collect_files_glob(Arena *str_arena, Vector *files, char *pattern) {
+	glob_t result;
+	if (glob(pattern, 0, NULL, &result) != 0) {
+		return;
+	}
+	for (size_t i = 0; i < result.gl_pathc; i++) {
+		append(char *, files,
+			   string(string_from(str_arena, result.gl_pathv[i])));
+	}
+	globfree(&result);
+}
 
-	if (dir != NULL) {
-		while ((entry = readdir(dir)) != NULL) {
-			if (STR_CMP(entry->d_name, ".") == 0 ||
-				STR_CMP(entry->d_name, "..") == 0) {
-				continue;
+/* Matches a '/' separated path against a glob pattern. Components are
+ * matched with fnmatch, a `**` component matches any number of components,
+ * none included */
+bool path_glob_match(const char *pattern, const char *path) {
+	if (strncmp(pattern, "**", 2) == 0 &&
+		(pattern[2] == '/' || pattern[2] == '\0')) {
+		const char *rest = pattern[2] == '/' ? pattern + 3 : pattern + 2;
+		if (*rest == '\0') {
+			return true;
+		}
+		for (const char *p = path; p != NULL; p = strchr(p, '/')) {
+			p += *p == '/';
+			if (path_glob_match(rest, p)) {
+				return true;
 			}
+		}
+		return false;
+	}
+
+	const char *pattern_end = strchr(pattern, '/');
+	const char *path_end = strchr(path, '/');
+	size_t pattern_len =
+		pattern_end ? (size_t)(pattern_end - pattern) : strlen(pattern);
+	size_t path_len = path_end ? (size_t)(path_end - path) : strlen(path);
+	char pattern_part[256], path_part[256];
+	if (pattern_len >= sizeof(pattern_part) || path_len >= sizeof(path_part)) {
+		return false;
+	}
+	memcpy(pattern_part, pattern, pattern_len);
+	pattern_part[pattern_len] = '\0';
+	memcpy(path_part, path, path_len);
+	path_part[path_len] = '\0';
+	if (fnmatch(pattern_part, path_part, FNM_PERIOD) != 0) {
+		return false;
+	}
 
-			char *dot = strrchr(entry->d_name, '.');
-			if (dot != NULL && (STR_CMP(dot, string(ext_1)) == 0 ||
-								STR_CMP(dot, string(ext_2)) == 0)) {
+	if (pattern_end == NULL || path_end == NULL) {
+		/* a trailing `**` component also matches the directory before it */
+		return pattern_end == NULL ? path_end == NULL
+								   : strcmp(pattern_end, "/**") == 0;
+	}
+	return path_glob_match(pattern_end + 1, path_end + 1);
+}
 
-				if (string_len(src_files) > 0) {
-					src_files = string_concat_cstr(str_arena, 2,
-												   string(src_files), sep);
-				}
+/* Removes the regular files directly inside `path`, the directory itself is
+ * kept */
+void remove_dir_files(const char *path) {
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+	char file_path[BUFFER_SIZE];
 
-				src_files =
-					string_concat_cstr(str_arena, 4, string(src_files),
-									   string(path), "/", entry->d_name);
-			}
+	if (dir == NULL) {
+		return;
+	}
+	while ((entry = readdir(dir)) != NULL) {
+		if (STR_CMP(entry->d_name, ".") == 0 ||
+			STR_CMP(entry->d_name, "..") == 0) {
+			continue;
 		}
-		closedir(dir);
+		snprintf(file_path, sizeof(file_path), "%s/%s", path, entry->d_name);
+		unlink(file_path);
 	}
-	return src_files;
+	closedir(dir);
 }
 
-void get_files_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-				   yyjson_val *deps, String *cwd, String *file_type) {
-	String *retrieve_type = file_type;
-
-	if (STR_CMP(string(file_type), "header") == 0) {
-		retrieve_type = string_from(str_arena, "include_paths");
-	} else if (STR_CMP(string(file_type), "static") == 0) {
-		retrieve_type = string_from(str_arena, "static_lib");
-	} else if (STR_CMP(string(file_type), "dyn") == 0) {
-		retrieve_type = string_from(str_arena, "shared_lib");
-	} else {
-		retrieve_type = string_clone(str_arena, file_type);
-	}
-
-	yyjson_val *src_arr = yyjson_obj_get(root, string(retrieve_type));
-	if (yyjson_is_arr(src_arr)) {
-		yyjson_arr_iter iter;
-		yyjson_arr_iter_init(src_arr, &iter);
-		yyjson_val *val;
-		while ((val = yyjson_arr_iter_next(&iter))) {
-
-			Vector *src_temp_arr = string_split_lines(
-				str_arena,
-				collect_files(
-					str_arena,
-					string_from(str_arena, (char *)yyjson_get_str(val)),
-					string_from(str_arena, string(file_type))));
-			for (int i = 0; i < length(src_temp_arr); i++) {
-				char *elem = string(at(String *, src_temp_arr, i));
-				if (STR_CMP(elem, "") != 0) {
-					append(char *, source_files, elem);
-				}
-			}
-			vector_free(src_temp_arr);
+/* Creates `path` and any missing parent */
+int make_dirs(char *path) {
+	for (char *p = path + 1; *p != '\0'; p++) {
+		if (*p != '/') {
+			continue;
+		}
+		*p = '\0';
+		int err = MAKE_DIR(path) && errno != EEXIST;
+		*p = '/';
+		if (err) {
+			return 1;
 		}
 	}
+	return MAKE_DIR(path) && errno != EEXIST;
+}
 
-	if (yyjson_is_obj(deps) && yyjson_obj_size(deps) != 0) {
-		yyjson_obj_iter iter;
-		yyjson_obj_iter_init(deps, &iter);
-		yyjson_val *key, *dep_obj;
-		while ((key = yyjson_obj_iter_next(&iter))) {
-			dep_obj = yyjson_obj_iter_get_val(key);
-			const char *dep_name = yyjson_get_str(key);
-
-			yyjson_val *dep_src =
-				yyjson_obj_get(dep_obj, string(retrieve_type));
-			if (yyjson_is_arr(dep_src) && yyjson_arr_size(dep_src) != 0) {
-				yyjson_arr_iter src_iter;
-				yyjson_arr_iter_init(dep_src, &src_iter);
-				yyjson_val *src_val;
-				while ((src_val = yyjson_arr_iter_next(&src_iter))) {
-					String *path = string_concat_cstr(
-						str_arena, 5, string(cwd), "/deps/", (char *)dep_name,
-						"/", (char *)yyjson_get_str(src_val));
-					Vector *src_temp_arr = string_split_lines(
-						str_arena,
-						collect_files(
-							str_arena, path,
-							string_from(str_arena, string(file_type))));
-					for (int i = 0; i < length(src_temp_arr); i++) {
-						char *elem = string(at(String *, src_temp_arr, i));
-						if (STR_CMP(elem, "") != 0) {
-							append(char *, source_files, elem);
-						}
-					}
-					vector_free(src_temp_arr);
-				}
-			}
-		}
+/* `path` relative to `dir` when it's inside it, else `path` unchanged */
+const char *path_relative_to(const char *path, const char *dir) {
+	size_t dir_len = strlen(dir);
+	if (strncmp(path, dir, dir_len) == 0 && path[dir_len] == '/') {
+		return path + dir_len + 1;
 	}
+	return path;
 }
 
-void get_src_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-				 yyjson_val *deps, String *cwd) {
-	get_files_vec(str_arena, source_files, root, deps, cwd,
-				  string_from(str_arena, "src"));
+void file_stamp_from_stat(struct stat *attr, FileStamp *stamp) {
+	stamp->exists = true;
+	stamp->size = (long long)attr->st_size;
+#if defined(__APPLE__)
+	stamp->mtime = (long long)attr->st_mtimespec.tv_sec * 1000000000LL +
+				   attr->st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+	stamp->mtime =
+		(long long)attr->st_mtim.tv_sec * 1000000000LL + attr->st_mtim.tv_nsec;
+#else
+	stamp->mtime = (long long)attr->st_mtime * 1000000000LL;
+#endif
 }
 
-void get_header_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-					yyjson_val *deps, String *cwd) {
-	get_files_vec(str_arena, source_files, root, deps, cwd,
-				  string_from(str_arena, "header"));
+bool get_file_stamp(const char *path, FileStamp *stamp) {
+	struct stat attr;
+	if (stat(path, &attr) != 0) {
+		stamp->exists = false;
+		stamp->mtime = 0;
+		stamp->size = 0;
+		return false;
+	}
+	file_stamp_from_stat(&attr, stamp);
+	return true;
 }
 
-void get_stat_lib_vec(Arena *str_arena, Vector *source_files, yyjson_val *root,
-					  yyjson_val *deps, String *cwd) {
-	get_files_vec(str_arena, source_files, root, deps, cwd,
-				  string_from(str_arena, "static"));
+long long get_file_modified_time(const char *path) {
+	FileStamp stamp;
+	get_file_stamp(path, &stamp);
+	return stamp.mtime;
 }
-void get_shared_lib_vec(Arena *str_arena, Vector *source_files,
-						yyjson_val *root, yyjson_val *deps, String *cwd) {
-	get_files_vec(str_arena, source_files, root, deps, cwd,
-				  string_from(str_arena, "dyn"));
+
+/* Appends `n` characters to the token being read, growing it as needed */
+static void dep_token_append(char **token, size_t *len, size_t *capacity,
+							 const char *chars, size_t n) {
+	if (*len + n + 1 > *capacity) {
+		while (*len + n + 1 > *capacity) {
+			*capacity *= 2;
+		}
+		*token = (char *)realloc(*token, *capacity);
+	}
+	memcpy(*token + *len, chars, n);
+	*len += n;
 }
 
-long long get_file_modified_time(const char *path) {
-	struct stat attr;
-	if (stat(path, &attr) == 0) {
-		return (long long)attr.st_mtime;
+/* Steps over the whitespace and line continuations between tokens, they
+ * are a few bytes long and a kernel call per byte costs more than it saves */
+static size_t skip_dep_separators(const char *buf, size_t pos, size_t size) {
+	for (; pos < size; pos++) {
+		if (buf[pos] == '\\' && pos + 1 < size &&
+			(buf[pos + 1] == '\n' || buf[pos + 1] == '\r')) {
+			pos++;
+		} else if (!isspace((unsigned char)buf[pos])) {
+			break;
+		}
 	}
-	return 0;
+	return pos;
 }
 
-bool are_headers_newer(const char *d_file_path, long long obj_time) {
-	FILE *f = fopen(d_file_path, "r");
+/* Reads the prerequisites listed in a make style `.d` file, targets (tokens
+ * ending with ':') are skipped. The file is read whole and runs of plain
+ * path characters are skipped over with `scan_find_special`, only spaces,
+ * '\\' and '$' are looked at one by one. Returns NULL when the file can't
+ * be read */
+Vector *read_dep_file(Arena *arena, const char *d_file_path) {
+	FILE *f = fopen(d_file_path, "rb");
 	if (!f)
-		return false;
+		return NULL;
 
-	char token[1024];
-	bool should_recompile = false;
-
-	while (fscanf(f, "%1023s", token) == 1) {
-		size_t len = strlen(token);
-		if (len == 0)
-			continue;
-
-		if (strcmp(token, "\\") == 0)
-			continue;
+	struct stat attr;
+	if (fstat(fileno(f), &attr) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	size_t size = (size_t)attr.st_size;
+	char *buf = (char *)malloc(size + 1);
+	size = fread(buf, 1, size, f);
+	fclose(f);
 
-		if (token[len - 1] == ':') {
-			token[len - 1] = '\0';
-			len--;
+	Vector *deps = vector_init(char *);
+	size_t capacity = 256, len = 0, pos = 0;
+	char *token = (char *)malloc(capacity);
 
-			if (len == 0)
-				continue;
+	for (;;) {
+		if (len == 0) {
+			pos = skip_dep_separators(buf, pos, size);
 		}
-
-		if (strstr(token, ".cache/") != NULL && strstr(token, ".o") != NULL) {
-			continue;
+		size_t run = scan_find_special(buf + pos, size - pos, '\\', '$');
+		dep_token_append(&token, &len, &capacity, buf + pos, run);
+		pos += run;
+
+		bool split = pos == size;
+		if (!split) {
+			char c = buf[pos++];
+			char next = pos < size ? buf[pos] : '\n';
+
+			if (c == '\\' && (next == '\n' || next == '\r')) {
+				/* line continuation */
+				pos += pos < size;
+				split = true;
+			} else if (c == '\\' &&
+					   (next == ' ' || next == '#' || next == '\\')) {
+				dep_token_append(&token, &len, &capacity, &next, 1);
+				pos++;
+			} else if (c == '$') {
+				pos += next == '$';
+				dep_token_append(&token, &len, &capacity, &c, 1);
+			} else if (isspace((unsigned char)c)) {
+				split = true;
+			} else {
+				dep_token_append(&token, &len, &capacity, &c, 1);
+			}
 		}
 
-		long long dep_file_time = get_file_modified_time(token);
-		if (dep_file_time > obj_time) {
-			should_recompile = true;
-			break;
+		if (split) {
+			if (len > 0 && token[len - 1] != ':') {
+				token[len] = '\0';
+				append(char *, deps, string(string_from(arena, token)));
+			}
+			len = 0;
+			if (pos == size) {
+				break;
+			}
 		}
 	}
 
-	fclose(f);
-	return should_recompile;
+	free(token);
+	free(buf);
+	return deps;
 }
 
 bool directory_exists(const char *path) {
@@ -0,0 +1,130 @@
+#include <mybuild.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+/*
+ * XXH64 (https://github.com/Cyan4973/xxHash), a fast non-cryptographic hash
+ * used for compile command hashes and file content digests.
+ * */
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val) {
+	acc ^= xxh64_round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash_bytes(const void *data, size_t len, uint64_t seed) {
+	const unsigned char *p = (const unsigned char *)data;
+	const unsigned char *end = p + len;
+	uint64_t h64;
+
+	if (len >= 32) {
+		const unsigned char *limit = end - 32;
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+
+		do {
+			v1 = xxh64_round(v1, read64(p));
+			v2 = xxh64_round(v2, read64(p + 8));
+			v3 = xxh64_round(v3, read64(p + 16));
+			v4 = xxh64_round(v4, read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h64 = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h64 = xxh64_merge(h64, v1);
+		h64 = xxh64_merge(h64, v2);
+		h64 = xxh64_merge(h64, v3);
+		h64 = xxh64_merge(h64, v4);
+	} else {
+		h64 = seed + PRIME64_5;
+	}
+
+	h64 += (uint64_t)len;
+
+	while (p + 8 <= end) {
+		h64 ^= xxh64_round(0, read64(p));
+		h64 = rotl64(h64, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h64 ^= (uint64_t)read32(p) * PRIME64_1;
+		h64 = rotl64(h64, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h64 ^= (*p) * PRIME64_5;
+		h64 = rotl64(h64, 11) * PRIME64_1;
+		p++;
+	}
+
+	h64 ^= h64 >> 33;
+	h64 *= PRIME64_2;
+	h64 ^= h64 >> 29;
+	h64 *= PRIME64_3;
+	h64 ^= h64 >> 32;
+	return h64;
+}
+
+uint64_t hash_string(const char *str, uint64_t seed) {
+	/* the terminator is hashed too, so "ab" + "c" differs from "a" + "bc" */
+	return hash_bytes(str, strlen(str) + 1, seed);
+}
+
+int hash_file(const char *path, uint64_t *digest) {
+	struct stat attr;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return 1;
+	}
+	if (fstat(fd, &attr) != 0) {
+		close(fd);
+		return 1;
+	}
+
+	if (attr.st_size == 0) {
+		*digest = hash_bytes("", 0, 0);
+		close(fd);
+		return 0;
+	}
+
+	void *data = mmap(NULL, attr.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return 1;
+	}
+
+	*digest = hash_bytes(data, attr.st_size, 0);
+	munmap(data, attr.st_size);
+	return 0;
+}
@@ -0,0 +1,191 @@
+#include <mybuild.h>
+
+#include <poll.h>
+
+typedef struct {
+	Process proc;
+	char *label;
+	JobResult *result;
+	char *err_buf;
+	size_t err_len;
+	size_t err_cap;
+} Job;
+
+struct JobPool {
+	Job *slots;
+	struct pollfd *fds;
+	int max_jobs;
+	int running;
+	int failed;
+	bool keep_going;
+};
+
+int get_cpu_count() {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+JobPool *job_pool_init(Arena *arena, int max_jobs, bool keep_going) {
+	JobPool *pool = (JobPool *)arena_alloc(arena, sizeof(JobPool));
+
+	if (max_jobs < 1) {
+		max_jobs = get_cpu_count();
+	}
+
+	pool->slots = (Job *)arena_alloc(arena, sizeof(Job) * max_jobs);
+	pool->fds =
+		(struct pollfd *)arena_alloc(arena, sizeof(struct pollfd) * max_jobs);
+	pool->max_jobs = max_jobs;
+	pool->running = 0;
+	pool->failed = 0;
+	pool->keep_going = keep_going;
+
+	return pool;
+}
+
+/* Appends whatever the job wrote to stderr, returns false once the pipe is
+ * closed */
+static bool job_read_stderr(Job *job) {
+	char buffer[BUFFER_SIZE];
+	ssize_t bytes_read = read(job->proc.err_fd, buffer, sizeof(buffer));
+
+	if (bytes_read < 0) {
+		return errno == EINTR || errno == EAGAIN;
+	}
+	if (bytes_read == 0) {
+		return false;
+	}
+
+	if (job->err_len + bytes_read > job->err_cap) {
+		size_t new_cap = job->err_cap ? job->err_cap * 2 : BUFFER_SIZE;
+		while (new_cap < job->err_len + bytes_read) {
+			new_cap *= 2;
+		}
+		char *new_buf = (char *)realloc(job->err_buf, new_cap);
+		if (new_buf == NULL) {
+			return true;
+		}
+		job->err_buf = new_buf;
+		job->err_cap = new_cap;
+	}
+	memcpy(job->err_buf + job->err_len, buffer, bytes_read);
+	job->err_len += bytes_read;
+	return true;
+}
+
+static void job_finish(JobPool *pool, int slot) {
+	Job *job = &pool->slots[slot];
+	int status = process_wait(&job->proc);
+
+	if (job->err_len > 0) {
+		fwrite(job->err_buf, 1, job->err_len, stderr);
+	}
+
+	if (job->result != NULL && status == 0) {
+		job->result->succeeded = true;
+		job->result->output = job->err_buf;
+		job->result->output_len = job->err_len;
+	} else {
+		free(job->err_buf);
+	}
+
+	if (status == 0) {
+		printf("[✓] Compiled '%s'\n", job->label);
+	} else {
+		fprintf(stderr, "Error encountered at compilation of '%s'\n",
+				job->label);
+		pool->failed++;
+	}
+
+	pool->slots[slot] = pool->slots[pool->running - 1];
+	pool->running--;
+}
+
+/* Blocks until at least one running job exits and releases its slot, draining
+ * the stderr pipes of all running jobs in the meantime */
+static void job_pool_reap(JobPool *pool) {
+	for (;;) {
+		for (int i = 0; i < pool->running; i++) {
+			pool->fds[i].fd = pool->slots[i].proc.err_fd;
+			pool->fds[i].events = POLLIN;
+			pool->fds[i].revents = 0;
+		}
+
+		if (poll(pool->fds, pool->running, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("poll failed");
+			job_finish(pool, 0);
+			return;
+		}
+
+		for (int i = pool->running - 1; i >= 0; i--) {
+			if (pool->fds[i].revents == 0) {
+				continue;
+			}
+			if (!job_read_stderr(&pool->slots[i])) {
+				job_finish(pool, i);
+				return;
+			}
+		}
+	}
+}
+
+/* Whether the job's process has exited, without reaping it */
+static bool job_exited(Job *job) {
+	siginfo_t info;
+	info.si_pid = 0;
+	return waitid(P_PID, job->proc.pid, &info,
+				  WEXITED | WNOHANG | WNOWAIT) == 0 &&
+		   info.si_pid != 0;
+}
+
+/* Finishes the jobs that already exited without waiting for the others, so
+ * a failure is noticed before more work is launched */
+static void job_pool_collect(JobPool *pool) {
+	for (int i = pool->running - 1; i >= 0; i--) {
+		Job *job = &pool->slots[i];
+		if (!job_exited(job)) {
+			continue;
+		}
+		struct pollfd fd = {.fd = job->proc.err_fd, .events = POLLIN};
+		while (poll(&fd, 1, 0) > 0 && job_read_stderr(job)) {
+		}
+		job_finish(pool, i);
+	}
+}
+
+bool job_pool_submit(JobPool *pool, Vector *args, char *label,
+					 JobResult *result) {
+	job_pool_collect(pool);
+	while (pool->running >= pool->max_jobs) {
+		job_pool_reap(pool);
+	}
+
+	if (pool->failed && !pool->keep_going) {
+		return false;
+	}
+
+	Job *job = &pool->slots[pool->running];
+	if (process_spawn(&job->proc, args, NULL, true)) {
+		pool->failed++;
+		return pool->keep_going;
+	}
+
+	job->label = label;
+	job->result = result;
+	job->err_buf = NULL;
+	job->err_len = 0;
+	job->err_cap = 0;
+	pool->running++;
+
+	return true;
+}
+
+int job_pool_wait(JobPool *pool) {
+	while (pool->running > 0) {
+		job_pool_reap(pool);
+	}
+	return pool->failed;
+}
@@ -0,0 +1,436 @@
+#include <mybuild.h>
+
+/*
+ * `myBuild cc [--] <compiler> <args...>` puts the compile cache in front of
+ * compiles run by other build systems, e.g. as CMAKE_C_COMPILER_LAUNCHER.
+ * Compiles of a single source with `-c` and `-o` are looked up with the same
+ * keys `myBuild build` uses, anything the cache can't reproduce runs the
+ * compiler unchanged.
+ * */
+
+typedef struct {
+	char *obj;
+	char *source;
+	int sources;
+	char *dep_file;
+	char *dep_target;
+	bool compile_only;
+	bool dep_requested;
+	/* -MD, system headers are listed in the `.d` file too */
+	bool system_deps;
+	bool debug_info;
+	bool phony_targets;
+	bool cacheable;
+	/* options that change where system headers are searched */
+	Vector *search_args;
+	bool language_given;
+} LaunchCommand;
+
+/* Options producing something besides the object, reading inputs the `.d`
+ * file doesn't list, or not compiling at all. A trailing `*` matches any
+ * suffix */
+static const char *uncacheable_options[] = {
+	"-", "-E", "-S", "-M", "-MM", "-MJ*", "-save-temps*", "--coverage",
+	"-ftest-coverage", "-fprofile-use*", "-fauto-profile*",
+	"-fbranch-probabilities", "-gsplit-dwarf", "-ftime-trace*", "-fdump-*",
+	"-fstack-usage", "-fcallgraph-info*", "-fplugin*", "-fmodules*",
+	"-specs*", "-Wp,*", "-Xclang", "@*", NULL};
+
+/* Options taking their value as the next argument */
+static const char *value_options[] = {
+	"-I", "-D", "-U", "-include", "-imacros", "-isystem", "-iquote",
+	"-idirafter", "-iprefix", "-iwithprefix", "-isysroot", "-x", "-arch",
+	"-target", "--sysroot", "-Xlinker", "-Xassembler", "-Xpreprocessor", "-L",
+	"-l", "-T", "-u", "--param", "-aux-info", NULL};
+
+/* Options changing the system include directories, a trailing `*` matches
+ * any suffix. Those taking a value are in `value_options` as well */
+static const char *search_options[] = {
+	"-isystem*", "-idirafter*", "-isysroot*", "--sysroot*", "-target",
+	"--target=*", "-x*", "-nostdinc*", "-nostdlibinc", "-m32", "-m64", NULL};
+
+static bool option_listed(const char **options, const char *arg) {
+	for (int i = 0; options[i] != NULL; i++) {
+		size_t len = strlen(options[i]);
+		if (options[i][len - 1] == '*'
+				? strncmp(arg, options[i], len - 1) == 0
+				: strcmp(arg, options[i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Value of `-X value` or `-Xvalue`, NULL when `arg` is a different option */
+static char *option_value(int argc, char *argv[], int *i, const char *option) {
+	size_t len = strlen(option);
+	if (strncmp(argv[*i], option, len) != 0) {
+		return NULL;
+	}
+	if (argv[*i][len] != '\0') {
+		return argv[*i] + len;
+	}
+	return *i + 1 < argc ? argv[++*i] : NULL;
+}
+
+/* Collects the arguments that shape the object in `key_args`; the options
+ * that only affect the `.d` file are left out, so where it's written doesn't
+ * change the key */
+static void launch_parse(int argc, char *argv[], Vector *key_args,
+						 LaunchCommand *cmd) {
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->cacheable = true;
+	cmd->search_args = vector_init(char *);
+	append(char *, key_args, argv[0]);
+
+	for (int i = 1; i < argc; i++) {
+		char *arg = argv[i];
+		char *value;
+		if (option_listed(search_options, arg)) {
+			append(char *, cmd->search_args, arg);
+			if (option_listed(value_options, arg) && i + 1 < argc) {
+				append(char *, cmd->search_args, argv[i + 1]);
+			}
+			cmd->language_given |= strncmp(arg, "-x", 2) == 0;
+		}
+
+		if (strcmp(arg, "-c") == 0) {
+			cmd->compile_only = true;
+		} else if (strcmp(arg, "-MD") == 0 || strcmp(arg, "-MMD") == 0) {
+			cmd->dep_requested = true;
+			cmd->system_deps |= arg[2] == 'D';
+			continue;
+		} else if (strcmp(arg, "-MP") == 0) {
+			cmd->phony_targets = true;
+			continue;
+		} else if ((value = option_value(argc, argv, &i, "-MF")) != NULL) {
+			cmd->dep_file = value;
+			continue;
+		} else if ((value = option_value(argc, argv, &i, "-MT")) != NULL ||
+				   (value = option_value(argc, argv, &i, "-MQ")) != NULL) {
+			/* a restored `.d` file always names the object */
+			cmd->cacheable &= cmd->dep_target == NULL;
+			cmd->dep_target = value;
+			continue;
+		} else if (option_listed(uncacheable_options, arg)) {
+			cmd->cacheable = false;
+		} else if (strncmp(arg, "-g", 2) == 0) {
+			cmd->debug_info = strcmp(arg, "-g0") != 0;
+		} else if (strncmp(arg, "-o", 2) == 0) {
+			cmd->obj = option_value(argc, argv, &i, "-o");
+			if (arg[2] == '\0' && cmd->obj != NULL) {
+				append(char *, key_args, arg);
+				arg = cmd->obj;
+			}
+		} else if (option_listed(value_options, arg) && i + 1 < argc) {
+			append(char *, key_args, arg);
+			arg = argv[++i];
+		} else if (arg[0] != '-') {
+			cmd->source = arg;
+			cmd->sources++;
+		}
+		append(char *, key_args, arg);
+	}
+
+	cmd->cacheable = cmd->cacheable && cmd->compile_only &&
+					 cmd->sources == 1 && cmd->obj != NULL &&
+					 strcmp(cmd->obj, "-") != 0 &&
+					 (cmd->dep_target == NULL ||
+					  strcmp(cmd->dep_target, cmd->obj) == 0);
+}
+
+/* Where the compiler would have put the `.d` file: `-MF`, or the object
+ * with its suffix replaced */
+static char *launch_dep_file(Arena *arena, LaunchCommand *cmd) {
+	if (cmd->dep_file != NULL) {
+		return cmd->dep_file;
+	}
+	String *obj = string_from(arena, cmd->obj);
+	char *name = strrchr(string(obj), '/');
+	char *dot = strrchr(name != NULL ? name : string(obj), '.');
+	if (dot != NULL) {
+		*dot = '\0';
+	}
+	return string(string_concat_cstr(arena, 2, string(obj), ".d"));
+}
+
+/* What -MP adds: an empty rule for every input besides the source, so make
+ * doesn't stop when a header is removed */
+static void add_phony_targets(Arena *arena, const char *d_file) {
+	Vector *deps = read_dep_file(arena, d_file);
+	FILE *out = deps != NULL ? fopen(d_file, "a") : NULL;
+	for (int i = 1; out != NULL && i < length(deps); i++) {
+		fputc('\n', out);
+		for (char *c = at(char *, deps, i); *c != '\0'; c++) {
+			if (*c == ' ' || *c == '#') {
+				fputc('\\', out);
+			}
+			fputc(*c, out);
+		}
+		fputs(":\n", out);
+	}
+	if (out != NULL) {
+		fclose(out);
+	}
+	if (deps != NULL) {
+		vector_free(deps);
+	}
+}
+
+/* Runs the compiler with its stderr collected in `output`, malloc'd */
+static int launch_captured(Vector *args, char **output, size_t *output_len) {
+	Process proc;
+	if (process_spawn(&proc, args, NULL, true)) {
+		return 127;
+	}
+
+	size_t capacity = BUFFER_SIZE;
+	*output = (char *)malloc(capacity);
+	*output_len = 0;
+	for (;;) {
+		if (*output_len == capacity) {
+			capacity *= 2;
+			*output = (char *)realloc(*output, capacity);
+		}
+		ssize_t got =
+			read(proc.err_fd, *output + *output_len, capacity - *output_len);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			break;
+		}
+		*output_len += got;
+	}
+
+	int status = process_wait(&proc);
+	return status < 0 ? 1 : status;
+}
+
+/* Same, with the compiler's stderr passed on */
+static int launch_compile(Vector *args, char **output, size_t *output_len) {
+	int status = launch_captured(args, output, output_len);
+	fwrite(*output, 1, *output_len, stderr);
+	return status;
+}
+
+/* Language of the source for `-x`, from its suffix */
+static const char *source_language(const char *source) {
+	const char *dot = source != NULL ? strrchr(source, '.') : NULL;
+	if (dot == NULL || strcmp(dot, ".c") == 0 || strcmp(dot, ".i") == 0) {
+		return "c";
+	}
+	if (strcmp(dot, ".m") == 0) {
+		return "objective-c";
+	}
+	if (strcmp(dot, ".mm") == 0) {
+		return "objective-c++";
+	}
+	return "c++";
+}
+
+/* Directories the compiler searches for system headers: `-isystem`,
+ * `-idirafter` and its own, as `-v` prints them. Asked once per compiler and
+ * set of options, the answer is kept next to the compile cache */
+static Vector *system_include_dirs(Arena *arena, CompileCache *cache,
+								   String *identity, char *compiler,
+								   LaunchCommand *cmd) {
+	Vector *probe = vector_init(char *);
+	append(char *, probe, compiler);
+	append_all(probe, cmd->search_args);
+	if (!cmd->language_given) {
+		append(char *, probe, "-x");
+		append(char *, probe, (char *)source_language(cmd->source));
+	}
+	append(char *, probe, "-E");
+	append(char *, probe, "-v");
+	append(char *, probe, "-o");
+	append(char *, probe, "/dev/null");
+	append(char *, probe, "/dev/null");
+
+	uint64_t hash = hash_string(string(identity), 0);
+	for (int i = 0; i < length(probe); i++) {
+		hash = hash_string(at(char *, probe, i), hash);
+	}
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+	String *dir = string_concat_cstr(arena, 2, compile_cache_dir(cache),
+									 "/sysdirs");
+	String *path = string_concat_cstr(arena, 3, string(dir), "/", name);
+
+	Vector *dirs = vector_init(char *);
+	FILE *in = fopen(string(path), "r");
+	char line[BUFFER_SIZE];
+	while (in != NULL && fgets(line, sizeof(line), in) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		append(char *, dirs, string(string_from(arena, line)));
+	}
+	if (in != NULL) {
+		fclose(in);
+		vector_free(probe);
+		return dirs;
+	}
+
+	char *output = NULL;
+	size_t output_len = 0;
+	if (launch_captured(probe, &output, &output_len) == 0) {
+		output = (char *)realloc(output, output_len + 1);
+		output[output_len] = '\0';
+		char *list = strstr(output, "#include <...> search starts here:\n");
+		char *end = list != NULL ? strstr(list, "End of search list.") : NULL;
+		StringBuilder sb;
+		string_builder_init(&sb, BUFFER_SIZE);
+		for (char *dir_line = list != NULL ? strchr(list, '\n') + 1 : NULL;
+			 dir_line != NULL && dir_line < end && *dir_line == ' ';) {
+			char *eol = strchr(dir_line, '\n');
+			*eol = '\0';
+			/* clang marks macOS framework directories */
+			char *mark = strstr(dir_line, " (framework directory)");
+			if (mark != NULL) {
+				*mark = '\0';
+			}
+			append(char *, dirs, string(string_from(arena, dir_line + 1)));
+			string_builder_append(&sb, dir_line + 1);
+			string_builder_append_char(&sb, '\n');
+			dir_line = eol + 1;
+		}
+		String *content = string_builder_finish(arena, &sb);
+		if (end != NULL && make_dirs(string(dir)) == 0) {
+			create_append_file(string(path), string(content));
+		}
+	}
+	free(output);
+	vector_free(probe);
+	return dirs;
+}
+
+/* Turns the `-MD` style `.d` file into what -MMD would have written, leaving
+ * out headers from system directories */
+static void drop_system_deps(Arena *arena, const char *d_file,
+							 const char *obj, Vector *system_dirs) {
+	Vector *deps = read_dep_file(arena, d_file);
+	if (deps == NULL) {
+		return;
+	}
+	StringBuilder sb;
+	string_builder_init(&sb, BUFFER_SIZE);
+	bool first = true;
+	for (int i = 0; i < length(deps); i++) {
+		char *dep = at(char *, deps, i);
+		bool system = false;
+		for (int j = 0; j < length(system_dirs) && !system; j++) {
+			char *dir = at(char *, system_dirs, j);
+			size_t len = strlen(dir);
+			system = strncmp(dep, dir, len) == 0 && dep[len] == '/';
+		}
+		if (!system) {
+			if (!first) {
+				string_builder_append_char(&sb, '\t');
+			}
+			string_builder_append(&sb, dep);
+			first = false;
+		}
+	}
+	write_dep_file(d_file, obj, string(string_builder_finish(arena, &sb)));
+	vector_free(deps);
+}
+
+int launcher_command(int argc, char *argv[]) {
+	if (argc > 0 && strcmp(argv[0], "--") == 0) {
+		argc--;
+		argv++;
+	}
+	if (argc == 0) {
+		printf("Usage: myBuild cc [--] <compiler> <args...>\n");
+		return 1;
+	}
+
+	Arena *arena = arena_init(BUFFER_SIZE);
+	Vector *args = vector_init(char *);
+	CompileCache *cache = NULL;
+	BuildLog *log = NULL;
+	char *output = NULL;
+	size_t output_len = 0;
+	int ret;
+
+	LaunchCommand cmd;
+	launch_parse(argc, argv, args, &cmd);
+	if (cmd.cacheable) {
+		/* the command is taken as it is, nothing maps the directory away
+		 * like `myBuild build` does, so paths aren't made relative */
+		cache = compile_cache_open(arena, "/");
+	}
+	if (cache == NULL) {
+		vector_free(args);
+		args = vector_init(char *);
+		for (int i = 0; i < argc; i++) {
+			append(char *, args, argv[i]);
+		}
+		ret = process_run(args, NULL);
+		ret = ret < 0 ? 127 : ret;
+		goto CLEANUP;
+	}
+
+	/* always -MD, system headers are inputs of the entry too. A caller
+	 * asking for -MMD gets them removed afterwards */
+	append(char *, args, "-MD");
+
+	/* debug info records the directory the compiler ran in, relative
+	 * sources in another directory don't produce the same object */
+	String *cwd = string_from(arena, "");
+	if (cmd.debug_info) {
+		char dir[BUFFER_SIZE];
+		if (GET_WD(dir, sizeof(dir)) != NULL) {
+			cwd = string_from(arena, dir);
+		}
+	}
+
+	/* only this compile's inputs are hashed, nothing is kept between runs */
+	log = build_log_load(arena, "/dev/null");
+	String *identity = get_compiler_identity(arena, argv[0]);
+	uint64_t key = compile_cache_key(cache, identity, cwd, args);
+	char *d_file = cmd.dep_requested
+					   ? launch_dep_file(arena, &cmd)
+					   : string(string_concat_cstr(arena, 2, cmd.obj,
+												   ".mybuild.d"));
+
+	if (compile_cache_fetch(cache, log, key, cmd.obj, d_file)) {
+		ret = 0;
+	} else {
+		append(char *, args, "-MF");
+		append(char *, args, d_file);
+		ret = launch_compile(args, &output, &output_len);
+		if (ret == 0) {
+			compile_cache_store(cache, log, key, cmd.obj, d_file, output,
+								output_len);
+		}
+	}
+
+	/* -MP's rules are added here, after system headers are dropped */
+	if (!cmd.dep_requested) {
+		unlink(d_file);
+	} else if (ret == 0) {
+		if (!cmd.system_deps) {
+			Vector *system_dirs =
+				system_include_dirs(arena, cache, identity, argv[0], &cmd);
+			drop_system_deps(arena, d_file, cmd.obj, system_dirs);
+			vector_free(system_dirs);
+		}
+		if (cmd.phony_targets) {
+			add_phony_targets(arena, d_file);
+		}
+	}
+
+CLEANUP:
+	if (cache != NULL) {
+		compile_cache_close(cache);
+	}
+	if (log != NULL) {
+		build_log_free(log);
+	}
+	free(output);
+	vector_free(args);
+	vector_free(cmd.search_args);
+	arena_free(&arena);
+	return ret;
+}
@@ -34,7 +34,7 @@ void sync_dependency() {
 	yyjson_mut_val *deps = yyjson_mut_obj_get(build_root, "dependencies");
 	yyjson_mut_val *inst_pkg = yyjson_mut_obj_get(package_root, "packages");
 
-	Vector *installed = vector_init(char *);
+	HashSet *installed = string_set_init();
 	// Vector *dep_arr = vector_init(char *);
 	// Vector *not_installed = vector_init(char *);
 
@@ -83,9 +83,9 @@ void sync_dependency() {
 
 		yyjson_mut_val *package_arr = yyjson_mut_arr(packageConf_mut);
 
-		for (int i = 0; i < length(installed); i++) {
-			yyjson_mut_val *val =
-				yyjson_mut_str(packageConf_mut, at(char *, installed, i));
+		for (int i = 0; i < hashset_size(installed); i++) {
+			yyjson_mut_val *val = yyjson_mut_str(
+				packageConf_mut, (char *)hashset_at(installed, i));
 			yyjson_mut_arr_append(package_arr, val);
 		}
 		yyjson_mut_obj_put(package_root,
@@ -100,7 +100,7 @@ void sync_dependency() {
 	yyjson_mut_doc_free(packageConf_mut);
 	yyjson_doc_free(buildConf);
 	yyjson_doc_free(packageConf);
-	vector_free(installed);
+	hashset_free(installed);
 	// vector_free(dep_arr);
 	// vector_free(not_installed);
 }
@@ -110,7 +110,7 @@ void add_library(char *libURL) {
 	yyjson_doc *current_doc = yyjson_read_file("./myBuild.json", 0, NULL, &err);
 	yyjson_val *current_root = yyjson_doc_get_root(current_doc);
 	yyjson_val *dependencies = yyjson_obj_get(current_root, "dependencies");
-	Vector *set = vector_init(char *);
+	HashSet *set = string_set_init();
 	int idx = 0, max = 0;
 	yyjson_val *val, *key;
 	yyjson_obj_foreach(dependencies, idx, max, key, val) {
@@ -128,8 +128,9 @@ void add_library(char *libURL) {
 	yyjson_mut_val *package_arr = yyjson_mut_arr(package_mut);
 	// yyjson_mut_val *package_arr = yyjson_mut_obj_get(root, "packages");
 
-	for (int i = 0; i < length(set); i++) {
-		yyjson_mut_val *val = yyjson_mut_str(package_mut, at(char *, set, i));
+	for (int i = 0; i < hashset_size(set); i++) {
+		yyjson_mut_val *val =
+			yyjson_mut_str(package_mut, (char *)hashset_at(set, i));
 		yyjson_mut_arr_append(package_arr, val);
 	}
 	yyjson_mut_obj_put(root, yyjson_mut_str(package_mut, "packages"),
@@ -140,20 +141,40 @@ void add_library(char *libURL) {
 	update_package_file(package_mut);
 	yyjson_mut_doc_free(package_mut);
 	yyjson_doc_free(current_doc);
-	vector_free(set);
+	hashset_free(set);
 }
 
 String *clone_lib(Arena *arena, char *libURL) {
 	String *repo_name = string_from(arena, get_repo_name(arena, libURL));
 	printf("Installing %s...\n", string(repo_name));
-	String *command = string_concat_cstr(arena, 4, "git clone --quiet ", libURL,
-										 " ./deps/", string(repo_name));
-	system(string(command));
+	Vector *args = vector_init(char *);
+	append(char *, args, "git");
+	append(char *, args, "clone");
+	append(char *, args, "--quiet");
+	append(char *, args, libURL);
+	append(char *, args,
+		   string(string_concat_cstr(arena, 2, "./deps/", string(repo_name))));
+	process_run(args, NULL);
+	vector_free(args);
 	printf("Done!\n");
 	return repo_name;
 }
 
-void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
+/* Adds `deps/<repo_name>/<path>` to the set, the joined path is only kept when
+ * it wasn't in the set already */
+static void add_dep_path(Arena *arena, HashSet *set, String *repo_name,
+						 char *path) {
+	ArenaMark mark = arena_mark(arena);
+	char *dep_path = string(
+		string_concat_cstr(arena, 4, "deps/", string(repo_name), "/", path));
+	if (set_contains(set, dep_path)) {
+		arena_rewind(arena, mark);
+		return;
+	}
+	set_add(set, dep_path);
+}
+
+void fetch_library(HashSet *v, char *libURL, yyjson_mut_val *sync_src,
 				   yyjson_mut_val *sync_include_paths,
 				   yyjson_mut_val *sync_flags, yyjson_mut_val *sync_lib_links,
 				   yyjson_mut_val *sync_stat, yyjson_mut_val *sync_shared,
@@ -205,12 +226,12 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 	yyjson_val *dep_shared_lib = yyjson_obj_get(dep_root, "shared_lib");
 	char *version = (char *)yyjson_get_str(yyjson_obj_get(dep_root, "version"));
 
-	Vector *src_vec = vector_init(char *);
-	Vector *incl_vec = vector_init(char *);
-	Vector *flag_vec = vector_init(char *);
-	Vector *lib_link_vec = vector_init(char *);
-	Vector *stat_vec = vector_init(char *);
-	Vector *shared_vec = vector_init(char *);
+	HashSet *src_vec = string_set_init();
+	HashSet *incl_vec = string_set_init();
+	HashSet *flag_vec = string_set_init();
+	HashSet *lib_link_vec = string_set_init();
+	HashSet *stat_vec = string_set_init();
+	HashSet *shared_vec = string_set_init();
 
 	int idx = 0, max = 0;
 	yyjson_val *val, *key;
@@ -247,20 +268,16 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 	}
 	yyjson_arr_foreach(src, idx, max, val) {
 		if (!check_if_dep_path((char *)yyjson_get_str(val))) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_get_str(val)));
-			set_add(src_vec, src_path);
+			add_dep_path(str_arena, src_vec, repo_name,
+						 (char *)yyjson_get_str(val));
 		} else {
 			set_add(src_vec, (char *)yyjson_get_str(val));
 		}
 	}
 	if (sync && yyjson_mut_is_arr(sync_src)) {
 		yyjson_mut_arr_foreach(sync_src, idx, max, val_mut) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_mut_get_str(val_mut)));
-			set_add(src_vec, src_path);
+			add_dep_path(str_arena, src_vec, repo_name,
+						 (char *)yyjson_mut_get_str(val_mut));
 			// set_add(src_vec, (char *)yyjson_mut_get_str(val_mut));
 		}
 	}
@@ -271,20 +288,16 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 	}
 	yyjson_arr_foreach(headers, idx, max, val) {
 		if (!check_if_dep_path((char *)yyjson_get_str(val))) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_get_str(val)));
-			set_add(incl_vec, src_path);
+			add_dep_path(str_arena, incl_vec, repo_name,
+						 (char *)yyjson_get_str(val));
 		} else {
 			set_add(incl_vec, (char *)yyjson_get_str(val));
 		}
 	}
 	if (sync && yyjson_mut_is_arr(sync_include_paths)) {
 		yyjson_mut_arr_foreach(sync_include_paths, idx, max, val_mut) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_mut_get_str(val_mut)));
-			set_add(incl_vec, src_path);
+			add_dep_path(str_arena, incl_vec, repo_name,
+						 (char *)yyjson_mut_get_str(val_mut));
 			// set_add(incl_vec, (char *)yyjson_mut_get_str(val_mut));
 		}
 	}
@@ -295,20 +308,16 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 	}
 	yyjson_arr_foreach(dep_stat_lib, idx, max, val) {
 		if (!check_if_dep_path((char *)yyjson_get_str(val))) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_get_str(val)));
-			set_add(stat_vec, src_path);
+			add_dep_path(str_arena, stat_vec, repo_name,
+						 (char *)yyjson_get_str(val));
 		} else {
 			set_add(stat_vec, (char *)yyjson_get_str(val));
 		}
 	}
 	if (sync && yyjson_mut_is_arr(sync_stat)) {
 		yyjson_mut_arr_foreach(sync_stat, idx, max, val_mut) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_mut_get_str(val_mut)));
-			set_add(stat_vec, src_path);
+			add_dep_path(str_arena, stat_vec, repo_name,
+						 (char *)yyjson_mut_get_str(val_mut));
 			// set_add(incl_vec, (char *)yyjson_mut_get_str(val_mut));
 		}
 	}
@@ -319,50 +328,46 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 	}
 	yyjson_arr_foreach(dep_shared_lib, idx, max, val) {
 		if (!check_if_dep_path((char *)yyjson_get_str(val))) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_get_str(val)));
-			set_add(shared_vec, src_path);
+			add_dep_path(str_arena, shared_vec, repo_name,
+						 (char *)yyjson_get_str(val));
 		} else {
 			set_add(shared_vec, (char *)yyjson_get_str(val));
 		}
 	}
 	if (sync && yyjson_mut_is_arr(sync_shared)) {
 		yyjson_mut_arr_foreach(sync_shared, idx, max, val_mut) {
-			char *src_path = string(
-				string_concat_cstr(str_arena, 4, "deps/", string(repo_name),
-								   "/", (char *)yyjson_mut_get_str(val_mut)));
-			set_add(shared_vec, src_path);
+			add_dep_path(str_arena, shared_vec, repo_name,
+						 (char *)yyjson_mut_get_str(val_mut));
 			// set_add(incl_vec, (char *)yyjson_mut_get_str(val_mut));
 		}
 	}
 
 	if (current_flags != NULL) {
 		yyjson_mut_arr_clear(current_flags);
-		for (int i = 0; i < length(flag_vec); i++) {
+		for (int i = 0; i < hashset_size(flag_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, current_flags,
-								   at(char *, flag_vec, i));
+								   (char *)hashset_at(flag_vec, i));
 		}
 	} else {
 		yyjson_mut_val *temp_flag_arr = yyjson_mut_arr(current_mut_doc);
-		for (int i = 0; i < length(flag_vec); i++) {
+		for (int i = 0; i < hashset_size(flag_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, temp_flag_arr,
-								   at(char *, flag_vec, i));
+								   (char *)hashset_at(flag_vec, i));
 		}
 		yyjson_mut_obj_add_val(current_mut_doc, current_root, "flags",
 							   temp_flag_arr);
 	}
 	if (current_lib_links != NULL) {
 		yyjson_mut_arr_clear(current_lib_links);
-		for (int i = 0; i < length(lib_link_vec); i++) {
+		for (int i = 0; i < hashset_size(lib_link_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, current_lib_links,
-								   at(char *, lib_link_vec, i));
+								   (char *)hashset_at(lib_link_vec, i));
 		}
 	} else {
 		yyjson_mut_val *temp_lib_link_arr = yyjson_mut_arr(current_mut_doc);
-		for (int i = 0; i < length(lib_link_vec); i++) {
+		for (int i = 0; i < hashset_size(lib_link_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, temp_lib_link_arr,
-								   at(char *, lib_link_vec, i));
+								   (char *)hashset_at(lib_link_vec, i));
 		}
 		yyjson_mut_obj_add_val(current_mut_doc, current_root, "lib_links",
 							   temp_lib_link_arr);
@@ -370,42 +375,42 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 
 	// if (current_src != NULL) {
 	yyjson_mut_arr_clear(current_src);
-	for (int i = 0; i < length(src_vec); i++) {
+	for (int i = 0; i < hashset_size(src_vec); i++) {
 		yyjson_mut_arr_add_str(current_mut_doc, current_src,
-							   at(char *, src_vec, i));
+							   (char *)hashset_at(src_vec, i));
 	}
 	// }
 	yyjson_mut_arr_clear(current_incl);
-	for (int i = 0; i < length(incl_vec); i++) {
+	for (int i = 0; i < hashset_size(incl_vec); i++) {
 		yyjson_mut_arr_add_str(current_mut_doc, current_incl,
-							   at(char *, incl_vec, i));
+							   (char *)hashset_at(incl_vec, i));
 	}
 	if (current_stat_lib != NULL) {
 		yyjson_mut_arr_clear(current_stat_lib);
-		for (int i = 0; i < length(stat_vec); i++) {
+		for (int i = 0; i < hashset_size(stat_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, current_stat_lib,
-								   at(char *, stat_vec, i));
+								   (char *)hashset_at(stat_vec, i));
 		}
 	} else {
 		yyjson_mut_val *temp_stat_arr = yyjson_mut_arr(current_mut_doc);
-		for (int i = 0; i < length(stat_vec); i++) {
+		for (int i = 0; i < hashset_size(stat_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, temp_stat_arr,
-								   at(char *, stat_vec, i));
+								   (char *)hashset_at(stat_vec, i));
 		}
 		yyjson_mut_obj_add_val(current_mut_doc, current_root, "static_lib",
 							   temp_stat_arr);
 	}
 	if (current_shared_lib != NULL) {
 		yyjson_mut_arr_clear(current_shared_lib);
-		for (int i = 0; i < length(shared_vec); i++) {
+		for (int i = 0; i < hashset_size(shared_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, current_shared_lib,
-								   at(char *, shared_vec, i));
+								   (char *)hashset_at(shared_vec, i));
 		}
 	} else {
 		yyjson_mut_val *temp_shared_arr = yyjson_mut_arr(current_mut_doc);
-		for (int i = 0; i < length(shared_vec); i++) {
+		for (int i = 0; i < hashset_size(shared_vec); i++) {
 			yyjson_mut_arr_add_str(current_mut_doc, temp_shared_arr,
-								   at(char *, shared_vec, i));
+								   (char *)hashset_at(shared_vec, i));
 		}
 		yyjson_mut_obj_add_val(current_mut_doc, current_root, "shared_lib",
 							   temp_shared_arr);
@@ -454,12 +459,12 @@ void fetch_library(Vector *v, char *libURL, yyjson_mut_val *sync_src,
 						  NULL, NULL, NULL, false);
 		}
 	}
-	vector_free(flag_vec);
-	vector_free(lib_link_vec);
-	vector_free(src_vec);
-	vector_free(incl_vec);
-	vector_free(stat_vec);
-	vector_free(shared_vec);
+	hashset_free(flag_vec);
+	hashset_free(lib_link_vec);
+	hashset_free(src_vec);
+	hashset_free(incl_vec);
+	hashset_free(stat_vec);
+	hashset_free(shared_vec);
 	yyjson_mut_doc_free(current_mut_doc);
 	yyjson_doc_free(current_doc);
 	yyjson_doc_free(dep_doc);
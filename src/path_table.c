@@ -0,0 +1,155 @@
+#include <mybuild.h>
+
+/* Process wide path interning table. Every distinct path, after
+ * normalization, is stored once and gets a small stable ID, so the rest of
+ * the build keys its tables by ID and compares paths as integers. IDs start
+ * at 1, 0 is never handed out */
+
+typedef struct {
+	char *path;
+	uint64_t hash;
+} PathEntry;
+
+static struct {
+	Arena *arena;
+	Vector *entries;
+	uint32_t *slots;
+	size_t capacity;
+} table;
+
+/* Drops empty and `.` components and trailing slashes, `..` is kept since
+ * resolving it would need to look at symlinks. `dst` must hold
+ * strlen(src) + 2 bytes */
+static size_t path_normalize(char *dst, const char *src) {
+	size_t len = 0;
+	bool absolute = src[0] == '/';
+
+	if (absolute) {
+		dst[len++] = '/';
+	}
+	while (*src != '\0') {
+		while (*src == '/') {
+			src++;
+		}
+		const char *end = strchr(src, '/');
+		size_t part = end != NULL ? (size_t)(end - src) : strlen(src);
+		if (part == 0 || (part == 1 && src[0] == '.')) {
+			src += part;
+			continue;
+		}
+		if (len > 0 && dst[len - 1] != '/') {
+			dst[len++] = '/';
+		}
+		memcpy(dst + len, src, part);
+		len += part;
+		src += part;
+	}
+	if (len == 0) {
+		dst[len++] = '.';
+	}
+	dst[len] = '\0';
+	return len;
+}
+
+static uint32_t *path_slot(const char *path, uint64_t hash) {
+	size_t mask = table.capacity - 1;
+	size_t pos = hash & mask;
+	while (table.slots[pos] != 0) {
+		PathEntry *entry = &at(PathEntry, table.entries, table.slots[pos] - 1);
+		if (entry->hash == hash && strcmp(entry->path, path) == 0) {
+			break;
+		}
+		pos = (pos + 1) & mask;
+	}
+	return &table.slots[pos];
+}
+
+static void path_table_grow() {
+	free(table.slots);
+	table.capacity = table.capacity ? table.capacity * 2 : 1024;
+	table.slots = (uint32_t *)calloc(table.capacity, sizeof(uint32_t));
+
+	for (int i = 0; i < length(table.entries); i++) {
+		PathEntry *entry = &at(PathEntry, table.entries, i);
+		*path_slot(entry->path, entry->hash) = i + 1;
+	}
+}
+
+PathId path_intern(const char *path) {
+	if (table.arena == NULL) {
+		table.arena = arena_init(BUFFER_SIZE);
+		table.entries = vector_init(PathEntry);
+	}
+	if ((size_t)(length(table.entries) + 1) * 10 >= table.capacity * 7) {
+		path_table_grow();
+	}
+
+	char buffer[BUFFER_SIZE];
+	size_t size = strlen(path) + 2;
+	char *normalized = size <= sizeof(buffer) ? buffer : (char *)malloc(size);
+	size_t len = path_normalize(normalized, path);
+
+	uint64_t hash = hash_bytes(normalized, len, 0);
+	uint32_t *slot = path_slot(normalized, hash);
+	if (*slot == 0) {
+		PathEntry entry;
+		entry.path = (char *)arena_alloc_aligned(table.arena, len + 1, 1);
+		memcpy(entry.path, normalized, len + 1);
+		entry.hash = hash;
+		append(PathEntry, table.entries, entry);
+		*slot = length(table.entries);
+	}
+
+	if (normalized != buffer) {
+		free(normalized);
+	}
+	return *slot;
+}
+
+char *path_str(PathId id) {
+	return at(PathEntry, table.entries, id - 1).path;
+}
+
+/* One more than the largest ID handed out so far, for sizing arrays indexed
+ * by ID */
+PathId path_id_limit() {
+	return table.entries != NULL ? length(table.entries) + 1 : 1;
+}
+
+void path_table_free() {
+	free(table.slots);
+	if (table.arena != NULL) {
+		vector_free(table.entries);
+		arena_free(&table.arena);
+	}
+	table.entries = NULL;
+	table.slots = NULL;
+	table.capacity = 0;
+}
+
+int path_index_get(PathIndex *index, PathId id) {
+	if (id >= index->capacity) {
+		return -1;
+	}
+	return index->items[id] - 1;
+}
+
+void path_index_put(PathIndex *index, PathId id, int item) {
+	if (id >= index->capacity) {
+		size_t capacity = index->capacity ? index->capacity : 64;
+		while (capacity <= id) {
+			capacity *= 2;
+		}
+		index->items = (int *)realloc(index->items, sizeof(int) * capacity);
+		memset(index->items + index->capacity, 0,
+			   sizeof(int) * (capacity - index->capacity));
+		index->capacity = capacity;
+	}
+	index->items[id] = item + 1;
+}
+
+void path_index_free(PathIndex *index) {
+	free(index->items);
+	index->items = NULL;
+	index->capacity = 0;
+}
@@ -0,0 +1,163 @@
+/* posix_spawn_file_actions_addchdir_np is a GNU extension */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <mybuild.h>
+
+#include <fcntl.h>
+#include <spawn.h>
+
+extern char **environ;
+
+#if defined(__GLIBC__) &&                                                      \
+	(__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+#define HAVE_SPAWN_CHDIR 1
+#endif
+
+void split_command_words(Arena *arena, Vector *args, char *command) {
+	StrView rest = strview_from(command);
+	StrView word;
+	while (strview_split_next(&rest, ' ', &word)) {
+		if (word.len > 0) {
+			append(char *, args, string(string_from_view(arena, word)));
+		}
+	}
+}
+
+/* Converts the argument vector into the NULL terminated array exec expects */
+static char **args_to_argv(Vector *args) {
+	int count = length(args);
+	char **argv = (char **)malloc(sizeof(char *) * (count + 1));
+	if (argv == NULL) {
+		return NULL;
+	}
+	for (int i = 0; i < count; i++) {
+		argv[i] = at(char *, args, i);
+	}
+	argv[count] = NULL;
+	return argv;
+}
+
+#ifndef HAVE_SPAWN_CHDIR
+static int fork_exec_in_dir(pid_t *pid, char **argv, const char *cwd,
+							int err_fd) {
+	fflush(stdout);
+	*pid = fork();
+	if (*pid < 0) {
+		return errno;
+	}
+	if (*pid == 0) {
+		if (err_fd >= 0) {
+			dup2(err_fd, STDERR_FILENO);
+		}
+		if (chdir(cwd) != 0) {
+			_exit(127);
+		}
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	return 0;
+}
+#endif
+
+int process_spawn(Process *proc, Vector *args, const char *cwd,
+				  bool capture_stderr) {
+	int pipe_fds[2] = {-1, -1};
+	int err = 0;
+	char **argv;
+
+	proc->pid = -1;
+	proc->err_fd = -1;
+
+	if (length(args) == 0) {
+		return EINVAL;
+	}
+
+	argv = args_to_argv(args);
+	if (argv == NULL) {
+		return ENOMEM;
+	}
+
+	if (capture_stderr && pipe(pipe_fds) != 0) {
+		err = errno;
+		free(argv);
+		return err;
+	}
+	if (capture_stderr) {
+		fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+	}
+
+#ifndef HAVE_SPAWN_CHDIR
+	if (cwd != NULL) {
+		err = fork_exec_in_dir(&proc->pid, argv, cwd, pipe_fds[1]);
+		goto DONE;
+	}
+#endif
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (capture_stderr) {
+		posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDERR_FILENO);
+		posix_spawn_file_actions_addclose(&actions, pipe_fds[1]);
+	}
+#ifdef HAVE_SPAWN_CHDIR
+	if (cwd != NULL) {
+		posix_spawn_file_actions_addchdir_np(&actions, cwd);
+	}
+#endif
+
+	fflush(stdout);
+	err = posix_spawnp(&proc->pid, argv[0], &actions, NULL, argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+
+#ifndef HAVE_SPAWN_CHDIR
+DONE:
+#endif
+	if (capture_stderr) {
+		close(pipe_fds[1]);
+		if (err) {
+			close(pipe_fds[0]);
+		} else {
+			proc->err_fd = pipe_fds[0];
+		}
+	}
+	if (err) {
+		fprintf(stderr, "Unable to execute '%s': %s\n", argv[0],
+				strerror(err));
+		proc->pid = -1;
+	}
+	free(argv);
+	return err;
+}
+
+int process_wait(Process *proc) {
+	int status;
+
+	if (proc->err_fd >= 0) {
+		close(proc->err_fd);
+		proc->err_fd = -1;
+	}
+
+	while (waitpid(proc->pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return -1;
+		}
+	}
+
+	if (WIFEXITED(status)) {
+		return WEXITSTATUS(status);
+	}
+	if (WIFSIGNALED(status)) {
+		return 128 + WTERMSIG(status);
+	}
+	return -1;
+}
+
+int process_run(Vector *args, const char *cwd) {
+	Process proc;
+	if (process_spawn(&proc, args, cwd, false)) {
+		return -1;
+	}
+	return process_wait(&proc);
+}
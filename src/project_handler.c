@@ -149,168 +149,324 @@ CLEANUP:
 	return ret;
 }
 
-String *build_project(Arena *global_str_arena) {
-	printf("[✓] Compilation started\n");
-	String *command;
-	Arena *str_arena = arena_init(1024);
+/* Extracts every archive into its own directory under `./build/.cache/ar` and
+ * appends the member objects. An archive is only extracted again when its
+ * contents changed since the last extraction */
+static int extract_static_libs(Arena *str_arena, BuildLog *build_log,
+							   Vector *stat_libs, Vector *objects) {
+	int mkdir_err = MAKE_DIR("./build/.cache/ar");
+	if (mkdir_err && errno != EEXIST) {
+		fprintf(stderr, "Unable to create `ar` directory\n");
+		return 1;
+	}
 
-	int mkdir_err = 0, cmd_err = 0, create_append_err = 0, copy_err = 0;
+	for (int i = 0; i < length(stat_libs); i++) {
+		char *archive = at(char *, stat_libs, i);
+		char dir_name[32];
+		uint64_t digest;
 
-	mkdir_err = MAKE_DIR("build");
+		snprintf(dir_name, sizeof(dir_name), "%016llx",
+				 (unsigned long long)hash_string(archive, 0));
+		char *dir = string(
+			string_concat_cstr(str_arena, 2, "./build/.cache/ar/", dir_name));
 
-	if (mkdir_err) {
-		if (errno != EEXIST) {
-			fprintf(stderr, "Unable to create `build` directory\n");
-			goto CLEANUP;
+		if (!build_log_file_digest(build_log, path_intern(archive), &digest)) {
+			fprintf(stderr, "Unable to read static lib '%s'\n", archive);
+			return 1;
 		}
-	}
+		digest = digest ? digest : 1;
+
+		PathId dir_id = path_intern(dir);
+		if (!directory_exists(dir) ||
+			build_log_get_link(build_log, dir_id) != digest) {
+			build_log_set_link(build_log, dir_id, 0);
+			remove_dir_files(dir);
+			mkdir_err = MAKE_DIR(dir);
+			if (mkdir_err && errno != EEXIST) {
+				fprintf(stderr, "Unable to create '%s'\n", dir);
+				return 1;
+			}
 
-	mkdir_err = MAKE_DIR("./build/.cache");
+			Vector *args = vector_init(char *);
+			append(char *, args, "ar");
+			append(char *, args, "x");
+			append(char *, args, archive);
+			int cmd_err = process_run(args, dir);
+			vector_free(args);
+			if (cmd_err) {
+				return 1;
+			}
+			build_log_set_link(build_log, dir_id, digest);
+			printf("[✓] Extracted '%s'\n",
+				   get_filename_without_path(archive));
+		}
 
-	if (mkdir_err) {
-		if (errno != EEXIST) {
-			fprintf(stderr, "Unable to create `.cache` directory\n");
-			goto CLEANUP;
+		collect_files_glob(str_arena, objects,
+						   string(string_concat_cstr(str_arena, 2, dir,
+													 "/*.o")));
+	}
+	return 0;
+}
+
+/* Index of the dependency a source belongs to, -1 for the project's own */
+static int source_dependency(ProjectModel *model, const char *src) {
+	src = path_relative_to(src, model->cwd);
+	while (strncmp(src, "./", 2) == 0) {
+		src += 2;
+	}
+	if (strncmp(src, "deps/", 5) != 0) {
+		return -1;
+	}
+	src += 5;
+	for (int i = 0; i < length(model->dependencies); i++) {
+		const char *name = at(char *, model->dependencies, i);
+		size_t len = strlen(name);
+		if (strncmp(src, name, len) == 0 && src[len] == '/') {
+			return i;
 		}
 	}
+	return -1;
+}
 
-	String *cwd = get_current_working_dir(str_arena);
-	yyjson_read_err err;
-	yyjson_doc *doc = yyjson_read_file("./myBuild.json", 0, NULL, &err);
+/* Creates `./build/deps/<name>/obj`, returns the directory with a trailing
+ * slash or NULL */
+static char *dependency_obj_dir(Arena *str_arena, const char *name) {
+	char *dir = string(string_concat_cstr(str_arena, 2, "./build/deps/",
+										  (char *)name));
+	char *obj_dir = string(string_concat_cstr(str_arena, 2, dir, "/obj"));
+	if ((MAKE_DIR("./build/deps") && errno != EEXIST) ||
+		(MAKE_DIR(dir) && errno != EEXIST) ||
+		(MAKE_DIR(obj_dir) && errno != EEXIST)) {
+		fprintf(stderr, "Unable to create '%s'\n", obj_dir);
+		return NULL;
+	}
+	return string(string_concat_cstr(str_arena, 2, obj_dir, "/"));
+}
 
-	if (!doc) {
-		fprintf(stderr, "Read error: %s\n", err.msg);
-		goto CLEANUP;
+/* Keys every dependency with sources in the store and, for executables,
+ * looks its archive up there. Dependencies found don't need compiling */
+static void lookup_dependencies(DepStore *store, BuildLog *build_log,
+								ProjectModel *model, String *compiler_identity,
+								String *deps_response, int *owners,
+								uint64_t *keys, char **found) {
+	for (int d = 0; d < length(model->dependencies); d++) {
+		Vector *sources = vector_init(char *);
+		for (int i = 0; i < length(model->sources); i++) {
+			if (owners[i] == d) {
+				append(char *, sources, at(char *, model->sources, i));
+			}
+		}
+		if (length(sources) > 0) {
+			char *name = at(char *, model->dependencies, d);
+			char *version = at(char *, model->dep_versions, d);
+			keys[d] = dep_store_key(store, compiler_identity, deps_response,
+									sources);
+			found[d] =
+				dep_store_lookup(store, build_log, name, version, keys[d]);
+			if (found[d] != NULL) {
+				printf("[✓] Using '%s' from the store\n", name);
+			}
+		}
+		vector_free(sources);
 	}
+}
 
-	yyjson_val *root = yyjson_doc_get_root(doc);
-
-	String *project_name = string_from(
-		str_arena,
-		(char *)yyjson_get_str(yyjson_obj_get(root, "project_name")));
-
-	yyjson_val *header_arr = yyjson_obj_get(root, "include_paths");
-	yyjson_val *src_arr = yyjson_obj_get(root, "src");
-	yyjson_val *dep_arr = yyjson_obj_get(root, "dependencies");
-	yyjson_val *compiler_path = yyjson_obj_get(root, "compiler_path");
-	yyjson_val *executable = yyjson_obj_get(root, "executable");
-
-	bool isExec = yyjson_get_bool(executable);
-
-	String *header_list = string_from(str_arena, "");
-	String *src_list = string_from(str_arena, "");
-	String *compiler = string_concat_cstr(
-		str_arena, 2, (char *)yyjson_get_str(compiler_path), " ");
-
-	size_t idx = 0, max = 0;
-	yyjson_val *val, *key;
-
-	yyjson_arr_foreach(header_arr, idx, max, val) {
-		header_list =
-			string_concat_cstr(str_arena, 4, string(header_list), "\n\"-I./",
-							   (char *)yyjson_get_str(val), "\"");
-	}
-
-	idx = 0, max = 0;
-
-	Vector *src_file_arr = vector_init(char *);
-	Vector *stat_file_arr = vector_init(char *);
-	Vector *shared_file_arr = vector_init(char *);
-	get_src_vec(str_arena, src_file_arr, root, dep_arr,
-				get_current_working_dir(str_arena));
-	get_stat_lib_vec(str_arena, stat_file_arr, root, dep_arr,
-					 get_current_working_dir(str_arena));
-	get_shared_lib_vec(str_arena, shared_file_arr, root, dep_arr,
-					   get_current_working_dir(str_arena));
-
-	String *stat_lib = string_from(str_arena, "");
-	String *shared_lib = string_from(str_arena, "");
-
-	if (length(stat_file_arr) == 0) {
-		if (directory_exists("./static")) {
-			String *static_libs = collect_files(
-				str_arena,
-				string_concat_cstr(str_arena, 2, string(cwd), "/static"),
-				string_from(str_arena, "static"));
-			stat_lib = string_trim(str_arena, static_libs);
-			if (string_len(stat_lib) > 0) {
-				cmd_err = system(string(string_concat_cstr(
-					str_arena, 3, "for f in ", string(stat_lib),
-					"; do (cd ./build/.cache && ar x \"$f\"); done")));
-				if (cmd_err) {
-					fprintf(stderr,
-							"Error encountered while adding static libs\n");
-					goto CLEANUP;
-				}
+/* Archives the objects of every dependency into
+ * `./build/deps/<name>/lib<name>.a`, filling in `archives` with it, or with
+ * the store's archive for the dependencies found there. An archive is only
+ * made again when the dependency's version or one of its objects changed */
+static int archive_dependencies(Arena *str_arena, BuildLog *build_log,
+								ProjectModel *model, char **obj_files,
+								int *owners, int src_count,
+								char **store_archives, char **archives) {
+	for (int d = 0; d < length(model->dependencies); d++) {
+		char *name = at(char *, model->dependencies, d);
+		char *archive = string(string_concat_cstr(
+			str_arena, 5, "./build/deps/", name, "/lib", name, ".a"));
+		archives[d] = store_archives[d];
+		if (archives[d] != NULL) {
+			continue;
+		}
+
+		Vector *members = vector_init(char *);
+		for (int i = 0; i < src_count; i++) {
+			if (owners[i] == d) {
+				append(char *, members, obj_files[i]);
 			}
 		}
-	} else {
-		for (int i = 0; i < length(stat_file_arr); i++) {
-			cmd_err = system(string(string_concat_cstr(
-				str_arena, 5, "(cd ./build/.cache && ar x \"", string(cwd), "/",
-				at(char *, stat_file_arr, i), "\")")));
+		if (length(members) == 0) {
+			vector_free(members);
+			continue;
+		}
+
+		Vector *args = vector_init(char *);
+		append(char *, args, "ar");
+		append(char *, args, "rcs");
+		append(char *, args, archive);
+		append_all(args, members);
+
+		uint64_t hash = hash_string(at(char *, model->dep_versions, d), 0);
+		for (int i = 0; i < length(args); i++) {
+			hash = hash_string(at(char *, args, i), hash);
+		}
+		hash = hash_file_stamps(members, hash);
+		hash = hash ? hash : 1;
+		vector_free(members);
+
+		PathId archive_id = path_intern(archive);
+		if (!file_exists(archive) ||
+			build_log_get_link(build_log, archive_id) != hash) {
+			build_log_set_link(build_log, archive_id, 0);
+			/* `ar rcs` only adds members, start over so removed objects go
+			 * away */
+			unlink(archive);
+			int cmd_err = process_run(args, NULL);
 			if (cmd_err) {
-				fprintf(stderr, "Error encountered while adding static libs\n");
-				goto CLEANUP;
+				fprintf(stderr, "Error encountered while archiving '%s'\n",
+						name);
+				vector_free(args);
+				return 1;
 			}
+			stat_cache_invalidate(archive_id);
+			build_log_set_link(build_log, archive_id, hash);
+			printf("[✓] Archived 'lib%s.a'\n", name);
 		}
+		vector_free(args);
+		archives[d] = archive;
 	}
+	return 0;
+}
 
-	if (length(shared_file_arr) == 0) {
-		if (directory_exists("./shared")) {
-			String *shared_libs = collect_files(
-				str_arena,
-				string_concat_cstr(str_arena, 2, string(cwd), "/shared"),
-				string_from(str_arena, "dyn"));
-			shared_lib = string_trim(str_arena, shared_libs);
+/* Adds the dependencies built here to the store, and links the stored
+ * archives instead, so the next build links the same files */
+static void publish_dependencies(DepStore *store, BuildLog *build_log,
+								 DepsLog *deps_log, ProjectModel *model,
+								 char **obj_files, int *owners, int src_count,
+								 uint64_t *keys, char **store_archives,
+								 char **archives) {
+	for (int d = 0; d < length(model->dependencies); d++) {
+		if (store_archives[d] != NULL || archives[d] == NULL || keys[d] == 0) {
+			continue;
 		}
-	} else {
-		for (int i = 0; i < length(shared_file_arr); i++) {
-			if (string_len(shared_lib) == 0) {
-				shared_lib =
-					string_from(str_arena, at(char *, shared_file_arr, i));
-			} else {
-				shared_lib =
-					string_concat_cstr(str_arena, 3, string(shared_lib), " ",
-									   at(char *, shared_file_arr, i));
+		Vector *members = vector_init(char *);
+		for (int i = 0; i < src_count; i++) {
+			if (owners[i] == d) {
+				append(char *, members, obj_files[i]);
 			}
 		}
+		char *stored = dep_store_publish(
+			store, build_log, deps_log, at(char *, model->dependencies, d),
+			at(char *, model->dep_versions, d), keys[d], archives[d], members);
+		if (stored != NULL) {
+			archives[d] = stored;
+		}
+		vector_free(members);
 	}
+}
 
-	idx = 0, max = 0;
+String *build_project(Arena *global_str_arena, BuildOptions *opts) {
+	printf("[✓] Compilation started\n");
+	String *output = NULL;
+	BuildLog *build_log = NULL;
+	DepsLog *deps_log = NULL;
+	ProjectModel *model = NULL;
+	CompileCache *cache = NULL;
+	DepStore *store = NULL;
+	Vector *objects = NULL;
+	Vector *dep_archives = NULL;
+	Vector *archive_args = NULL;
+	/* holds every path and command of the build, reserve enough address
+	 * space that it stays one contiguous block for large trees */
+	Arena *str_arena = arena_init_reserved((size_t)1 << 30, 0);
 
-	if (dep_arr) {
-		yyjson_obj_foreach(dep_arr, idx, max, key, val) {
-			yyjson_val *dep_src_arr, *dep_include_arr, *elem;
-			int index, max_val;
-			char *key_str = (char *)yyjson_get_str(key);
+	int mkdir_err = 0, cmd_err = 0, create_append_err = 0, copy_err = 0;
 
-			dep_include_arr = yyjson_obj_get(val, "include_paths");
+	mkdir_err = MAKE_DIR("build");
 
-			index = 0, max_val = 0;
-			yyjson_arr_foreach(dep_include_arr, index, max_val, elem) {
-				header_list = string_concat_cstr(
-					str_arena, 7, string(header_list), "\n\"-I", "./deps/",
-					key_str, "/", (char *)yyjson_get_str(elem), "\"");
-			}
+	if (mkdir_err) {
+		if (errno != EEXIST) {
+			fprintf(stderr, "Unable to create `build` directory\n");
+			goto CLEANUP;
 		}
 	}
 
-	String *headers, *src;
-	headers = string_trim(str_arena, header_list);
+	mkdir_err = MAKE_DIR("./build/.cache");
+
+	if (mkdir_err) {
+		if (errno != EEXIST) {
+			fprintf(stderr, "Unable to create `.cache` directory\n");
+			goto CLEANUP;
+		}
+	}
 
-	String *response_content = string_concat_cstr(
-		str_arena, 4, "-c\n-fPIC\n-MMD\n-MP\n", string(headers), "\n",
-		string(get_flags(str_arena, root, string_from(str_arena, "build"))));
+	model = project_model_load(str_arena);
+	if (model == NULL) {
+		goto CLEANUP;
+	}
 
-	String *lib_links =
-		get_flags(str_arena, root, string_from(str_arena, "lib"));
+	bool isExec = model->is_exec;
+	char *compiler = model->compiler;
+	char *static_link = model->static_link;
+	bool extract_archives = STR_CMP(static_link, "archive") != 0 &&
+							STR_CMP(static_link, "whole-archive") != 0;
+
+	Vector *src_file_arr = model->sources;
+	Vector *stat_libs = model->stat_libs;
+	Vector *shared_libs = model->shared_libs;
+	Vector *header_vec = model->headers;
+
+	/* cached objects are shared by every build on the machine, system
+	 * headers have to be among the inputs they are looked up by */
+	char *base_flags =
+		opts->use_cache ? "-c\n-fPIC\n-MD\n-MP" : "-c\n-fPIC\n-MMD\n-MP";
+	StringBuilder sb;
+	string_builder_init(&sb, BUFFER_SIZE);
+	string_builder_append(&sb, base_flags);
+	for (int i = 0; i < length(model->include_dirs); i++) {
+		string_builder_append(&sb, "\n\"-I./");
+		string_builder_append(&sb, at(char *, model->include_dirs, i));
+		string_builder_append_char(&sb, '"');
+	}
+	for (int i = 0; i < length(model->flags); i++) {
+		string_builder_append_char(&sb, '\n');
+		string_builder_append(&sb, at(char *, model->flags, i));
+	}
+	String *response_content = string_builder_finish(str_arena, &sb);
+
+	/* dependencies only see each other's headers, not the project's include
+	 * paths, so how they are built doesn't depend on the project using them */
+	string_builder_init(&sb, BUFFER_SIZE);
+	string_builder_append(&sb, base_flags);
+	for (int i = 0; i < length(model->include_dirs); i++) {
+		char *dir = at(char *, model->include_dirs, i);
+		if (strncmp(dir, "deps/", 5) == 0) {
+			string_builder_append(&sb, "\n\"-I./");
+			string_builder_append(&sb, dir);
+			string_builder_append_char(&sb, '"');
+		}
+	}
+	for (int i = 0; i < length(model->flags); i++) {
+		string_builder_append_char(&sb, '\n');
+		string_builder_append(&sb, at(char *, model->flags, i));
+	}
+	String *deps_response = string_builder_finish(str_arena, &sb);
 
-	yyjson_doc_free(doc);
+	string_builder_init(&sb, BUFFER_SIZE);
+	for (int i = 0; i < length(model->lib_links); i++) {
+		if (i > 0) {
+			string_builder_append_char(&sb, '\n');
+		}
+		string_builder_append(&sb, at(char *, model->lib_links, i));
+	}
+	String *lib_links = string_builder_finish(str_arena, &sb);
 
 	create_append_err = create_append_file("./build/.cache/compile.rsp",
 										   string(response_content));
 	create_append_err =
+		create_append_err ||
+		create_append_file("./build/.cache/deps.rsp", string(deps_response));
+	create_append_err =
+		create_append_err ||
 		create_append_file("./build/.cache/lib_links.rsp", string(lib_links));
 	// create_append_file("./build/.cache/compile.rsp", string(static_libs));
 
@@ -319,62 +475,369 @@ String *build_project(Arena *global_str_arena) {
 		goto CLEANUP;
 	}
 
-	for (int i = 0; i < length(src_file_arr); i++) {
-		const char *base_name =
+	JobPool *pool = job_pool_init(str_arena, opts->jobs, opts->keep_going);
+	build_log = build_log_load(str_arena, BUILD_LOG_PATH);
+	deps_log = deps_log_open(str_arena, DEPS_LOG_PATH);
+	String *compiler_identity = get_compiler_identity(str_arena, compiler);
+	if (opts->use_cache) {
+		cache = compile_cache_open(str_arena, model->cwd);
+		/* only executables link dependency archives */
+		store = isExec ? dep_store_open(str_arena, model->cwd) : NULL;
+	}
+	/* debug info and __FILE__ name the checkout, mapping it away lets every
+	 * checkout use the same cached objects */
+	String *prefix_map = string_concat_cstr(str_arena, 3, "-ffile-prefix-map=",
+											model->cwd, "=.");
+
+	int src_count = length(src_file_arr);
+	char **obj_files =
+		(char **)arena_alloc(str_arena, sizeof(char *) * src_count);
+	PathId *obj_ids =
+		(PathId *)arena_alloc(str_arena, sizeof(PathId) * src_count);
+	uint64_t *command_hashes =
+		(uint64_t *)arena_alloc(str_arena, sizeof(uint64_t) * src_count);
+	char **d_files =
+		(char **)arena_alloc(str_arena, sizeof(char *) * src_count);
+	JobResult *results =
+		(JobResult *)arena_alloc(str_arena, sizeof(JobResult) * src_count);
+	uint64_t *cache_keys =
+		(uint64_t *)arena_alloc(str_arena, sizeof(uint64_t) * src_count);
+	int *owners = (int *)arena_alloc(str_arena, sizeof(int) * src_count);
+
+	/* a dependency's objects go next to its archive */
+	int dep_count = length(model->dependencies);
+	size_t dep_slots = dep_count > 0 ? dep_count : 1;
+	char **obj_dirs =
+		(char **)arena_alloc(str_arena, sizeof(char *) * dep_slots);
+	char **store_archives =
+		(char **)arena_alloc(str_arena, sizeof(char *) * dep_slots);
+	uint64_t *store_keys =
+		(uint64_t *)arena_alloc(str_arena, sizeof(uint64_t) * dep_slots);
+	for (int d = 0; d < dep_count; d++) {
+		obj_dirs[d] = NULL;
+		store_archives[d] = NULL;
+		store_keys[d] = 0;
+	}
+	for (int i = 0; i < src_count; i++) {
+		owners[i] = source_dependency(model, at(char *, src_file_arr, i));
+		int d = owners[i];
+		if (d >= 0 && obj_dirs[d] == NULL) {
+			obj_dirs[d] = dependency_obj_dir(
+				str_arena, at(char *, model->dependencies, d));
+			if (obj_dirs[d] == NULL) {
+				goto CLEANUP;
+			}
+		}
+	}
+	if (store != NULL) {
+		lookup_dependencies(store, build_log, model, compiler_identity,
+							deps_response, owners, store_keys, store_archives);
+	}
+
+	/* objects are named after the source file, sources sharing a name in
+	 * different directories get a hash of their path added */
+	HashMap *name_counts = hashmap_init(int);
+	for (int i = 0; i < src_count; i++) {
+		results[i] = (JobResult){false, NULL, 0};
+		cache_keys[i] = 0;
+		const char *name =
 			get_filename_without_path(at(char *, src_file_arr, i));
-		String *obj_file = string_concat_cstr(str_arena, 3, "./build/.cache/",
-											  base_name, ".o");
+		int *count = hashmap_get(int, name_counts, name);
+		if (count != NULL) {
+			(*count)++;
+		} else {
+			hashmap_put(int, name_counts, name, 1);
+		}
+	}
 
-		String *d_file = string_concat_cstr(str_arena, 3, "./build/.cache/",
-											base_name, ".d");
+	/* split once, every compile command starts with the same words */
+	Vector *compiler_words = vector_init(char *);
+	split_command_words(str_arena, compiler_words, compiler);
+
+	for (int i = 0; i < src_count; i++) {
+		const char *base_name =
+			get_filename_without_path(at(char *, src_file_arr, i));
+		char obj_name[BUFFER_SIZE];
+		if (*hashmap_get(int, name_counts, base_name) > 1) {
+			/* relative to the project, the name is the same in every
+			 * checkout */
+			const char *src =
+				path_relative_to(at(char *, src_file_arr, i), model->cwd);
+			uint32_t path_hash = (uint32_t)hash_string(src, 0);
+			snprintf(obj_name, sizeof(obj_name), "%s.%08x", base_name,
+					 path_hash);
+		} else {
+			snprintf(obj_name, sizeof(obj_name), "%s", base_name);
+		}
+		char *obj_dir =
+			owners[i] >= 0 ? obj_dirs[owners[i]] : "./build/.cache/";
+		String *obj_file =
+			string_concat_cstr(str_arena, 3, obj_dir, obj_name, ".o");
+		String *d_file =
+			string_concat_cstr(str_arena, 3, obj_dir, obj_name, ".d");
+
+		/* dependencies are built the same in every project, so they share
+		 * cache entries and store keys */
+		String *response = owners[i] >= 0 ? deps_response : response_content;
+		Vector *args = vector_init(char *);
+		append_all(args, compiler_words);
+		append(char *, args,
+			   owners[i] >= 0 ? "@./build/.cache/deps.rsp"
+							  : "@./build/.cache/compile.rsp");
+		if (cache != NULL) {
+			append(char *, args, string(prefix_map));
+		}
+		append(char *, args, at(char *, src_file_arr, i));
+		append(char *, args, "-o");
+		append(char *, args, string(obj_file));
+
+		PathId obj_id = path_intern(string(obj_file));
+		obj_files[i] = string(obj_file);
+		obj_ids[i] = obj_id;
+		d_files[i] = string(d_file);
+		command_hashes[i] =
+			hash_compile_command(compiler_identity, response, args);
+		if (owners[i] >= 0 && store_archives[owners[i]] != NULL) {
+			vector_free(args);
+			continue;
+		}
 
 		long long src_time =
-			get_file_modified_time(at(char *, src_file_arr, i));
-		long long obj_time = get_file_modified_time(string(obj_file));
+			stat_cache_mtime(path_intern(at(char *, src_file_arr, i)));
+		long long obj_time = stat_cache_mtime(obj_id);
 
 		bool need_recompile = false;
 
-		if (obj_time == 0 || src_time > obj_time) {
+		PathId *dep_ids;
+		if (deps_log_lookup(deps_log, obj_id, &dep_ids) < 0 &&
+			file_exists(string(d_file))) {
+			/* left over from a build that didn't record it yet */
+			deps_log_ingest(deps_log, obj_id, string(d_file));
+		}
+
+		if (obj_time == 0) {
+			need_recompile = true;
+		} else if (build_log_get(build_log, obj_id) != command_hashes[i]) {
 			need_recompile = true;
-		} else if (are_headers_newer(string(d_file), obj_time)) {
+		} else if (opts->content_hash) {
+			/* only a change of content counts, not a newer mtime */
+			uint64_t inputs =
+				build_log_inputs_digest(build_log, deps_log, obj_id);
+			need_recompile = inputs == 0 ||
+							 inputs != build_log_get_inputs(build_log, obj_id);
+		} else if (src_time > obj_time) {
+			need_recompile = true;
+		} else if (deps_log_newer_than(deps_log, obj_id, obj_time)) {
 			need_recompile = true;
 		}
 
+		bool submitted = true;
 		if (need_recompile) {
-			cmd_err = system(string(string_concat_cstr(
-				str_arena, 5, string(compiler), " @./build/.cache/compile.rsp ",
-				at(char *, src_file_arr, i), " -o ", string(obj_file))));
-			if (cmd_err) {
-				fprintf(stderr, "Error encountered at compilation\n");
-				goto CLEANUP;
+			/* forget the old record until the new object is in place */
+			build_log_set(build_log, obj_id, 0, 0);
+			if (cache != NULL) {
+				cache_keys[i] =
+					compile_cache_key(cache, compiler_identity, response, args);
 			}
-
-			printf("[✓] Compiled '%s'\n", base_name);
+			if (cache != NULL &&
+				compile_cache_fetch(cache, build_log, cache_keys[i],
+									string(obj_file), string(d_file))) {
+				printf("[✓] Restored '%s' from cache\n", base_name);
+				results[i].succeeded = true;
+				cache_keys[i] = 0;
+			} else {
+				submitted = job_pool_submit(pool, args, (char *)base_name,
+											&results[i]);
+			}
+		}
+		vector_free(args);
+		if (!submitted) {
+			break;
 		}
 	}
 
-	vector_free(src_file_arr);
-	vector_free(stat_file_arr);
-	vector_free(shared_file_arr);
+	int failed_jobs = job_pool_wait(pool);
+	vector_free(compiler_words);
+	hashmap_free(name_counts);
+
+	for (int i = 0; i < src_count; i++) {
+		if (results[i].succeeded) {
+			/* before the `.d` file is ingested and removed */
+			if (cache != NULL && cache_keys[i] != 0) {
+				compile_cache_store(cache, build_log, cache_keys[i],
+									obj_files[i], d_files[i],
+									results[i].output, results[i].output_len);
+			}
+			free(results[i].output);
+			stat_cache_invalidate(obj_ids[i]);
+			if (deps_log_ingest(deps_log, obj_ids[i], d_files[i])) {
+				fprintf(stderr, "Unable to record dependencies of '%s'\n",
+						obj_files[i]);
+				continue;
+			}
+			uint64_t inputs =
+				opts->content_hash
+					? build_log_inputs_digest(build_log, deps_log, obj_ids[i])
+					: 0;
+			build_log_set(build_log, obj_ids[i], command_hashes[i], inputs);
+		}
+	}
+	if (!failed_jobs) {
+		build_log_prune_objects(build_log, obj_ids, src_count);
+	}
+	build_log_save(build_log, BUILD_LOG_PATH);
 
-	String *output = string_concat_cstr(global_str_arena, 2, "./build/",
-										string(project_name));
+	if (failed_jobs) {
+		fprintf(stderr, "Error encountered at compilation\n");
+		goto CLEANUP;
+	}
 
+	String *target =
+		string_concat_cstr(global_str_arena, 2, "./build/", model->name);
+
+	/* executables link the dependencies as archives, so only the members
+	 * they use end up in them. Libraries keep all of it, whoever links them
+	 * may use any of it */
+	objects = vector_init(char *);
+	dep_archives = vector_init(char *);
+	archive_args = vector_init(char *);
+	vector_reserve(objects, src_count);
+	for (int i = 0; i < src_count; i++) {
+		if (owners[i] < 0 || !isExec) {
+			append(char *, objects, obj_files[i]);
+		}
+	}
 	if (isExec) {
-		cmd_err = system(string(string_concat_cstr(
-			str_arena, 6, string(compiler), " ./build/.cache/*.o ",
-			string(shared_lib), " -o ", string(output),
-			" @./build/.cache/lib_links.rsp")));
+		char **archives =
+			(char **)arena_alloc(str_arena, sizeof(char *) * dep_slots);
+		if (archive_dependencies(str_arena, build_log, model, obj_files,
+								 owners, src_count, store_archives,
+								 archives)) {
+			build_log_save(build_log, BUILD_LOG_PATH);
+			goto CLEANUP;
+		}
+		if (store != NULL) {
+			publish_dependencies(store, build_log, deps_log, model, obj_files,
+								 owners, src_count, store_keys, store_archives,
+								 archives);
+		}
+		for (int d = 0; d < dep_count; d++) {
+			if (archives[d] != NULL) {
+				append(char *, dep_archives, archives[d]);
+			}
+		}
+	}
 
-		if (cmd_err) {
-			fprintf(stderr, "Error encountered while generating executable\n");
+	if (length(dep_archives) > 0) {
+#ifndef __APPLE__
+		/* dependencies can use each other in any order */
+		append(char *, archive_args, "-Wl,--start-group");
+		append_all(archive_args, dep_archives);
+		append(char *, archive_args, "-Wl,--end-group");
+#else
+		append_all(archive_args, dep_archives);
+#endif
+	}
+	if (extract_archives) {
+		if (extract_static_libs(str_arena, build_log, stat_libs, objects)) {
+			fprintf(stderr, "Error encountered while adding static libs\n");
+			build_log_save(build_log, BUILD_LOG_PATH);
 			goto CLEANUP;
 		}
-		printf("[✓] Executable ganerated\n");
+	} else if (length(stat_libs) > 0) {
+		bool whole = STR_CMP(static_link, "whole-archive") == 0;
+		if (whole) {
+			append(char *, archive_args, "-Wl,--whole-archive");
+		}
+		append_all(archive_args, stat_libs);
+		if (whole) {
+			append(char *, archive_args, "-Wl,--no-whole-archive");
+		}
+	}
+
+	/* everything the link step reads, a change in any of them relinks */
+	uint64_t link_hash = hash_string(string(compiler_identity), 0);
+	link_hash = hash_string(string(lib_links), link_hash);
+	link_hash = hash_file_stamps(objects, link_hash);
+	if (isExec) {
+		link_hash = hash_file_stamps(dep_archives, link_hash);
+	}
+	if (!extract_archives) {
+		/* extracted members are already part of `objects` */
+		link_hash = hash_file_stamps(stat_libs, link_hash);
+	}
+	link_hash = hash_file_stamps(shared_libs, link_hash);
+	link_hash = hash_file_stamps(header_vec, link_hash);
+	if (link_hash == 0) {
+		link_hash = 1;
+	}
+
+	if (isExec) {
+		Vector *args = vector_init(char *);
+		split_command_words(str_arena, args, compiler);
+		append_all(args, objects);
+		append_all(args, archive_args);
+		append_all(args, shared_libs);
+		append(char *, args, "-o");
+		append(char *, args, string(target));
+		append(char *, args, "@./build/.cache/lib_links.rsp");
+		for (int i = 0; i < length(args); i++) {
+			link_hash = hash_string(at(char *, args, i), link_hash);
+		}
+
+		if (file_exists(string(target)) &&
+			build_log_get_link(build_log, path_intern(string(target))) ==
+				link_hash) {
+			printf("[✓] Executable up to date\n");
+		} else {
+			cmd_err = process_run(args, NULL);
+			if (cmd_err) {
+				fprintf(stderr,
+						"Error encountered while generating executable\n");
+				vector_free(args);
+				goto CLEANUP;
+			}
+			build_log_set_link(build_log, path_intern(string(target)),
+							   link_hash);
+			printf("[✓] Executable ganerated\n");
+		}
+		vector_free(args);
 	} else {
-		Vector *header_vec = vector_init(char *);
+		char *shared_out = string(string_concat_cstr(
+			str_arena, 3, "./build/shared/lib/lib", model->name, ".so"));
+		char *static_out = string(string_concat_cstr(
+			str_arena, 3, "./build/static/lib/lib", model->name, ".a"));
+
+		Vector *args = vector_init(char *);
+		split_command_words(str_arena, args, compiler);
+		append(char *, args, "-shared");
+		append_all(args, objects);
+		append_all(args, archive_args);
+		append(char *, args, "-o");
+		append(char *, args, shared_out);
+		append(char *, args, "@./build/.cache/lib_links.rsp");
+
+		Vector *ar_args = vector_init(char *);
+		append(char *, ar_args, "ar");
+		append(char *, ar_args, "rcs");
+		append(char *, ar_args, static_out);
+		append_all(ar_args, objects);
+
+		for (int i = 0; i < length(args); i++) {
+			link_hash = hash_string(at(char *, args, i), link_hash);
+		}
+		for (int i = 0; i < length(ar_args); i++) {
+			link_hash = hash_string(at(char *, ar_args, i), link_hash);
+		}
 
-		get_header_vec(str_arena, header_vec, root, dep_arr, cwd);
+		if (file_exists(shared_out) && file_exists(static_out) &&
+			build_log_get_link(build_log, path_intern(shared_out)) ==
+				link_hash) {
+			printf("[✓] Libraries up to date\n");
+			vector_free(args);
+			vector_free(ar_args);
+			goto DONE;
+		}
 
 		mkdir_err = MAKE_DIR("./build/static");
 		mkdir_err = MAKE_DIR("./build/shared");
@@ -391,19 +854,20 @@ String *build_project(Arena *global_str_arena) {
 			}
 		}
 
-		cmd_err = system(string(string_concat_cstr(
-			str_arena, 5, string(compiler),
-			" -shared ./build/.cache/*.o -o ./build/shared/lib/lib",
-			string(project_name), ".so", " @./build/.cache/lib_links.rsp")));
+		cmd_err = process_run(args, NULL);
+		vector_free(args);
 
 		if (cmd_err) {
 			fprintf(stderr,
 					"Error encountered while generating shared library\n");
+			vector_free(ar_args);
 			goto CLEANUP;
 		}
-		cmd_err = system(string(
-			string_concat_cstr(str_arena, 3, "ar rcs ./build/static/lib/lib",
-							   string(project_name), ".a ./build/.cache/*.o")));
+
+		/* `ar rcs` only adds members, start over so removed objects go away */
+		unlink(static_out);
+		cmd_err = process_run(ar_args, NULL);
+		vector_free(ar_args);
 		if (cmd_err) {
 			fprintf(stderr,
 					"Error encountered while generating static library\n");
@@ -426,16 +890,59 @@ String *build_project(Arena *global_str_arena) {
 			}
 		}
 
+		build_log_set_link(build_log, path_intern(shared_out), link_hash);
 		printf("[✓] Libraries ganerated\n");
-		vector_free(header_vec);
 	}
 
+DONE:
+	build_log_save(build_log, BUILD_LOG_PATH);
+	output = target;
+
 CLEANUP:
+	if (objects != NULL) {
+		vector_free(objects);
+		vector_free(dep_archives);
+		vector_free(archive_args);
+	}
+	if (opts->print_stats) {
+		long hits, misses;
+		stat_cache_stats(&hits, &misses);
+		printf("[✓] Stat cache: %ld hits, %ld misses\n", hits, misses);
+		if (cache != NULL) {
+			long remote_hits;
+			compile_cache_stats(cache, &hits, &remote_hits, &misses);
+			printf("[✓] Compile cache: %ld hits (%ld remote), %ld misses\n",
+				   hits, remote_hits, misses);
+		}
+	}
+	if (cache != NULL) {
+		compile_cache_close(cache);
+	}
+	if (store != NULL) {
+		dep_store_close(store);
+	}
+	stat_cache_free();
+	if (build_log != NULL) {
+		build_log_free(build_log);
+	}
+	if (deps_log != NULL) {
+		deps_log_close(deps_log);
+	}
+	if (model != NULL) {
+		project_model_free(model);
+	}
+	path_table_free();
 	arena_free(&str_arena);
 	return output;
 }
 
-void run_project(Arena *global_str_arena) {
-	char *command = string(build_project(global_str_arena));
-	system(command);
+void run_project(Arena *global_str_arena, BuildOptions *opts) {
+	String *executable = build_project(global_str_arena, opts);
+	if (executable == NULL) {
+		return;
+	}
+	Vector *args = vector_init(char *);
+	append(char *, args, string(executable));
+	process_run(args, NULL);
+	vector_free(args);
 }
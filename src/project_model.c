@@ -0,0 +1,1059 @@
+#include <mybuild.h>
+
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+ * Resolved view of myBuild.json: every list the build needs, with the
+ * directory scans already done.
+ *
+ * The model is saved as a binary snapshot together with the stamps of the
+ * manifest and of every directory that was scanned. As long as none of those
+ * stamps changed, adding or removing a file would have touched a directory,
+ * so the snapshot is used as is and neither the JSON nor the directories are
+ * read again.
+ *
+ * When something did change, every directory listing is kept in a separate
+ * index, also revalidated by stamp, so only the directories that changed
+ * are read again while resolving.
+ *
+ * Resolving walks every directory the manifest reaches on a pool of
+ * threads first, then collects the files from the listings on one thread.
+ * Names are sorted within each listing, so the collected files come out in
+ * the same order however the walk was scheduled.
+ * */
+
+#define PROJECT_MODEL_MAGIC "MBMODEL\0"
+#define PROJECT_MODEL_VERSION 3
+#define DIR_INDEX_MAGIC "MBDIRS\0\0"
+#define DIR_INDEX_VERSION 2
+#define DIR_WALK_MAX_THREADS 16
+
+#define KIND_SOURCE 0
+#define KIND_HEADER 1
+#define KIND_STATIC 2
+#define KIND_SHARED 3
+
+typedef struct {
+	char *path;
+	FileStamp stamp;
+} WatchedPath;
+
+VECTOR_DECLARE(char_ptr, char *)
+
+typedef struct {
+	PathId path;
+	FileStamp stamp;
+	/* entries with an extension, and sub-directories */
+	vector_char_ptr files;
+	vector_char_ptr dirs;
+} DirListing;
+
+/* Listing of one directory read by the parallel walk, `cached` when the
+ * listing saved by the previous resolve is still valid */
+typedef struct {
+	FileStamp stamp;
+	DirListing *cached;
+	vector_char_ptr files;
+	vector_char_ptr dirs;
+	atomic_bool done;
+} WalkedDir;
+
+/* State of one resolve: directories walked and listed so far and every file
+ * collected, so a directory reachable under two spellings is read and added
+ * once. Listings saved by the previous resolve are reused while the
+ * directory's stamp didn't change */
+typedef struct {
+	Vector *listings;
+	PathIndex listed;
+	Vector *cached;
+	PathIndex cached_index;
+	char *cache_buffer;
+	PathIndex collected;
+	/* guards the path table and `walked` while the walk runs */
+	pthread_mutex_t walk_lock;
+	Vector *walked;
+	PathIndex walked_index;
+	Arena **walk_arenas;
+	int walk_workers;
+} ProjectScan;
+
+/* One `src`-like manifest entry being collected: files matching `pattern`
+ * are searched from `base`, `depth` levels down, -1 for no limit */
+typedef struct {
+	/* prefix of the matched paths, "" for the project itself */
+	char *root;
+	char *pattern;
+	char *base;
+	int depth;
+	yyjson_val *exclude;
+	int kind;
+	Vector *out;
+} ScanRule;
+
+/* A directory handle shared by the walk tasks of its sub-directories, which
+ * open them relative to it. Whoever drops the last reference closes it */
+typedef struct {
+	DIR *dir;
+	atomic_int refs;
+} WalkHandle;
+
+typedef struct {
+	ScanRule *rule;
+	char *rel;
+	int depth;
+	WalkHandle *parent;
+} WalkTask;
+
+typedef struct {
+	char *pos;
+	char *end;
+	bool ok;
+} SnapshotReader;
+
+static const char *kind_extensions[][5] = {
+	{".c", ".cpp", ".cc", ".cxx", NULL},
+	{".h", ".hpp", ".hh", ".hxx", NULL},
+	{".a", ".lib", NULL},
+	{".so", ".dll", NULL},
+};
+
+static char *json_str(yyjson_val *val) {
+	const char *str = yyjson_get_str(val);
+	return str != NULL ? (char *)str : "";
+}
+
+static void watch_path(Arena *arena, ProjectModel *model, char *path,
+					   FileStamp *stamp) {
+	WatchedPath watched;
+	watched.path = string(string_from(arena, path));
+	if (stamp != NULL) {
+		watched.stamp = *stamp;
+	} else {
+		get_file_stamp(path, &watched.stamp);
+	}
+	append(WatchedPath, model->watched, watched);
+}
+
+static int write_u32(FILE *out, uint32_t value) {
+	return fwrite(&value, sizeof(value), 1, out) != 1;
+}
+
+static int write_str(FILE *out, char *str) {
+	uint32_t len = strlen(str) + 1;
+	return write_u32(out, len) || fwrite(str, 1, len, out) != len;
+}
+
+static int write_list(FILE *out, Vector *list) {
+	int err = write_u32(out, length(list));
+	for (int i = 0; i < length(list) && !err; i++) {
+		err = write_str(out, at(char *, list, i));
+	}
+	return err;
+}
+
+static void *read_bytes(SnapshotReader *reader, size_t len) {
+	if (!reader->ok || (size_t)(reader->end - reader->pos) < len) {
+		reader->ok = false;
+		return NULL;
+	}
+	void *bytes = reader->pos;
+	reader->pos += len;
+	return bytes;
+}
+
+static uint32_t read_u32(SnapshotReader *reader) {
+	uint32_t value = 0;
+	void *bytes = read_bytes(reader, sizeof(value));
+	if (bytes != NULL) {
+		memcpy(&value, bytes, sizeof(value));
+	}
+	return value;
+}
+
+/* Strings are used straight from the snapshot buffer */
+static char *read_str(SnapshotReader *reader) {
+	uint32_t len = read_u32(reader);
+	char *str = (char *)read_bytes(reader, len);
+	if (str == NULL || len == 0 || str[len - 1] != '\0') {
+		reader->ok = false;
+		return "";
+	}
+	return str;
+}
+
+static void read_list(SnapshotReader *reader, Vector *list) {
+	uint32_t count = read_u32(reader);
+	if ((size_t)(reader->end - reader->pos) < count) {
+		reader->ok = false;
+		return;
+	}
+	vector_reserve(list, count);
+	for (uint32_t i = 0; i < count && reader->ok; i++) {
+		append(char *, list, read_str(reader));
+	}
+}
+
+static int write_names(FILE *out, vector_char_ptr *names) {
+	int err = write_u32(out, names->length);
+	for (size_t i = 0; i < names->length && !err; i++) {
+		err = write_str(out, names->items[i]);
+	}
+	return err;
+}
+
+static void read_names(SnapshotReader *reader, vector_char_ptr *names) {
+	uint32_t count = read_u32(reader);
+	if ((size_t)(reader->end - reader->pos) < count) {
+		reader->ok = false;
+		return;
+	}
+	vector_char_ptr_reserve(names, count);
+	for (uint32_t i = 0; i < count && reader->ok; i++) {
+		vector_char_ptr_push(names, read_str(reader));
+	}
+}
+
+/* Loads the listings saved by the previous resolve, names are used straight
+ * from the file's buffer */
+static void dir_index_load(ProjectScan *scan, const char *path) {
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) {
+		return;
+	}
+	struct stat attr;
+	if (fstat(fileno(in), &attr) != 0) {
+		fclose(in);
+		return;
+	}
+	char *buffer = (char *)malloc(attr.st_size + 1);
+	if (buffer == NULL ||
+		fread(buffer, 1, attr.st_size, in) != (size_t)attr.st_size) {
+		free(buffer);
+		fclose(in);
+		return;
+	}
+	fclose(in);
+	scan->cache_buffer = buffer;
+
+	SnapshotReader reader = {buffer, buffer + attr.st_size, true};
+	char *magic = (char *)read_bytes(&reader, 8);
+	if (magic == NULL || memcmp(magic, DIR_INDEX_MAGIC, 8) != 0 ||
+		read_u32(&reader) != DIR_INDEX_VERSION) {
+		return;
+	}
+
+	uint32_t count = read_u32(&reader);
+	for (uint32_t i = 0; i < count && reader.ok; i++) {
+		DirListing listing;
+		listing.path = path_intern(read_str(&reader));
+		listing.files = (vector_char_ptr){NULL, 0, 0};
+		listing.dirs = (vector_char_ptr){NULL, 0, 0};
+		void *stamp = read_bytes(&reader, sizeof(FileStamp));
+		if (stamp != NULL) {
+			memcpy(&listing.stamp, stamp, sizeof(FileStamp));
+		}
+		read_names(&reader, &listing.files);
+		read_names(&reader, &listing.dirs);
+		if (!reader.ok) {
+			vector_char_ptr_free(&listing.files);
+			vector_char_ptr_free(&listing.dirs);
+			break;
+		}
+		path_index_put(&scan->cached_index, listing.path,
+					   length(scan->cached));
+		append(DirListing, scan->cached, listing);
+	}
+}
+
+/* Saves the listings of this resolve, except for directories changed within
+ * the last second that could change again without their mtime moving */
+static void dir_index_save(ProjectScan *scan, const char *path) {
+	char tmp_path[BUFFER_SIZE];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE *out = fopen(tmp_path, "wb");
+	if (out == NULL) {
+		return;
+	}
+
+	long long recent = ((long long)time(NULL) - 1) * 1000000000LL;
+	uint32_t count = 0;
+	for (int i = 0; i < length(scan->listings); i++) {
+		DirListing *listing = &at(DirListing, scan->listings, i);
+		count += listing->stamp.exists && listing->stamp.mtime < recent;
+	}
+
+	uint32_t version = DIR_INDEX_VERSION;
+	int err = fwrite(DIR_INDEX_MAGIC, 1, 8, out) != 8 ||
+			  write_u32(out, version) || write_u32(out, count);
+	for (int i = 0; i < length(scan->listings) && !err; i++) {
+		DirListing *listing = &at(DirListing, scan->listings, i);
+		if (!listing->stamp.exists || listing->stamp.mtime >= recent) {
+			continue;
+		}
+		err = write_str(out, path_str(listing->path)) ||
+			  fwrite(&listing->stamp, sizeof(FileStamp), 1, out) != 1 ||
+			  write_names(out, &listing->files) ||
+			  write_names(out, &listing->dirs);
+	}
+
+	if (fclose(out) != 0 || err || rename(tmp_path, path) != 0) {
+		unlink(tmp_path);
+	}
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Reads the entries of an open directory, sorted by name so the order
+ * doesn't depend on the file system */
+static void read_dir_listing(Arena *arena, DIR *dir, vector_char_ptr *files,
+							 vector_char_ptr *dirs) {
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		char *name = entry->d_name;
+		if (STR_CMP(name, ".") == 0 || STR_CMP(name, "..") == 0) {
+			continue;
+		}
+
+		/* symlinked directories are not followed, they could loop */
+		bool is_dir = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if (entry->d_type == DT_DIR) {
+			is_dir = true;
+		} else if (entry->d_type == DT_UNKNOWN)
+#endif
+		{
+			struct stat attr;
+			is_dir = fstatat(dirfd(dir), name, &attr, AT_SYMLINK_NOFOLLOW) ==
+						 0 &&
+					 S_ISDIR(attr.st_mode);
+		}
+
+		if (is_dir && name[0] != '.') {
+			vector_char_ptr_push(dirs, string(string_from(arena, name)));
+		} else if (!is_dir && strrchr(name, '.') != NULL) {
+			vector_char_ptr_push(files, string(string_from(arena, name)));
+		}
+	}
+	/* an empty list has no items array yet, qsort mustn't see NULL */
+	if (files->length > 1) {
+		qsort(files->items, files->length, sizeof(char *), compare_names);
+	}
+	if (dirs->length > 1) {
+		qsort(dirs->items, dirs->length, sizeof(char *), compare_names);
+	}
+}
+
+static bool stamp_equal(FileStamp *a, FileStamp *b) {
+	return a->exists && b->exists && a->mtime == b->mtime &&
+		   a->size == b->size;
+}
+
+/* Reads a directory once per resolve, and only when it changed since the
+ * previous one. Directories reached by the walk are taken from there. The
+ * listing is returned by value since listing more directories moves the
+ * stored ones */
+static DirListing list_dir(Arena *arena, ProjectModel *model,
+						   ProjectScan *scan, char *path) {
+	PathId id = path_intern(path);
+	int item = path_index_get(&scan->listed, id);
+	if (item >= 0) {
+		return at(DirListing, scan->listings, item);
+	}
+
+	DirListing listing;
+	listing.path = id;
+	listing.files = (vector_char_ptr){NULL, 0, 0};
+	listing.dirs = (vector_char_ptr){NULL, 0, 0};
+	item = path_index_get(&scan->walked_index, id);
+	WalkedDir *walked = item >= 0 ? at(WalkedDir *, scan->walked, item) : NULL;
+	if (walked != NULL) {
+		listing.stamp = walked->stamp;
+	} else {
+		get_file_stamp(path, &listing.stamp);
+	}
+	watch_path(arena, model, path, &listing.stamp);
+
+	item = path_index_get(&scan->cached_index, id);
+	DirListing *cached =
+		item >= 0 ? &at(DirListing, scan->cached, item) : NULL;
+	if (cached != NULL && stamp_equal(&cached->stamp, &listing.stamp)) {
+		/* take over the names, the cached entry is not used again */
+		listing.files = cached->files;
+		listing.dirs = cached->dirs;
+		cached->files = (vector_char_ptr){NULL, 0, 0};
+		cached->dirs = (vector_char_ptr){NULL, 0, 0};
+	} else if (walked != NULL) {
+		listing.files = walked->files;
+		listing.dirs = walked->dirs;
+		walked->files = (vector_char_ptr){NULL, 0, 0};
+		walked->dirs = (vector_char_ptr){NULL, 0, 0};
+	} else if (listing.stamp.exists) {
+		DIR *dir = opendir(path);
+		if (dir != NULL) {
+			read_dir_listing(arena, dir, &listing.files, &listing.dirs);
+			closedir(dir);
+		}
+	}
+
+	path_index_put(&scan->listed, id, length(scan->listings));
+	append(DirListing, scan->listings, listing);
+	return listing;
+}
+
+static bool has_glob(const char *str) { return strpbrk(str, "*?[") != NULL; }
+
+static bool matches_kind(const char *name, int kind) {
+	const char *dot = strrchr(name, '.');
+	if (dot == NULL) {
+		return false;
+	}
+	for (int i = 0; kind_extensions[kind][i] != NULL; i++) {
+		if (STR_CMP(dot, kind_extensions[kind][i]) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool is_excluded(yyjson_val *exclude, const char *rel) {
+	size_t idx, max;
+	yyjson_val *val;
+	yyjson_arr_foreach(exclude, idx, max, val) {
+		if (path_glob_match(json_str(val), rel)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void add_collected(ProjectScan *scan, Vector *out, char *path,
+						  int kind) {
+	PathId id = path_intern(path);
+	if (path_index_get(&scan->collected, id) < 0) {
+		path_index_put(&scan->collected, id, kind);
+		append(char *, out, path_str(id));
+	}
+}
+
+/* The directory `rel` of the rule, as it is opened */
+static void rule_dir(ScanRule *rule, const char *rel, char *dir, size_t size) {
+	if (rule->root[0] == '\0') {
+		snprintf(dir, size, "%s", rel[0] != '\0' ? rel : ".");
+	} else {
+		snprintf(dir, size, "%s/%s", rule->root, rel);
+	}
+}
+
+/* Whether the rule descends into the sub-directory `name` of `rel`, whose
+ * path relative to the rule's root is written to `child` */
+static bool rule_descends(ScanRule *rule, const char *rel, const char *name,
+						  char *child, size_t size) {
+	if (rule->root[0] == '\0' && rel[0] == '\0' &&
+		(strcmp(name, "build") == 0 || strcmp(name, "deps") == 0)) {
+		/* managed by myBuild, dependencies have their own entries */
+		return false;
+	}
+	snprintf(child, size, "%s%s%s", rel, rel[0] != '\0' ? "/" : "", name);
+	return !is_excluded(rule->exclude, child);
+}
+
+/* Lists `rel`, relative to the rule's root, collects the files matching the
+ * rule and descends `depth` more levels, -1 for no limit */
+static void scan_dir(Arena *arena, ProjectModel *model, ProjectScan *scan,
+					 ScanRule *rule, const char *rel, int depth) {
+	char dir[BUFFER_SIZE];
+	char child[BUFFER_SIZE];
+	rule_dir(rule, rel, dir, sizeof(dir));
+
+	DirListing listing = list_dir(arena, model, scan, dir);
+	const char *sep = rel[0] != '\0' ? "/" : "";
+
+	for (size_t i = 0; i < listing.files.length; i++) {
+		char *name = listing.files.items[i];
+		snprintf(child, sizeof(child), "%s%s%s", rel, sep, name);
+		if (!matches_kind(name, rule->kind) ||
+			!path_glob_match(rule->pattern, child) ||
+			is_excluded(rule->exclude, child)) {
+			continue;
+		}
+
+		char *path = rule->root[0] == '\0'
+						 ? string(string_from(arena, child))
+						 : string(string_concat_cstr(arena, 3, rule->root,
+													 "/", child));
+		if ((rule->kind == KIND_STATIC || rule->kind == KIND_SHARED) &&
+			path[0] != '/') {
+			/* archives are extracted from within `./build/.cache` */
+			path = string(
+				string_concat_cstr(arena, 3, model->cwd, "/", path));
+		}
+		add_collected(scan, rule->out, path, rule->kind);
+	}
+
+	for (size_t i = 0; depth != 0 && i < listing.dirs.length; i++) {
+		if (rule_descends(rule, rel, listing.dirs.items[i], child,
+						  sizeof(child))) {
+			scan_dir(arena, model, scan, rule, child,
+					 depth > 0 ? depth - 1 : -1);
+		}
+	}
+}
+
+static void walk_release(WalkHandle *handle) {
+	if (handle != NULL && atomic_fetch_sub(&handle->refs, 1) == 1) {
+		closedir(handle->dir);
+		free(handle);
+	}
+}
+
+/* Opens the directory relative to its parent's handle, by path when the
+ * parent wasn't opened by this walk */
+static DIR *walk_open(WalkTask *task, const char *path) {
+	int fd = -1;
+	if (task->parent != NULL) {
+		const char *name = strrchr(task->rel, '/');
+		fd = openat(dirfd(task->parent->dir), name ? name + 1 : task->rel,
+					O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	}
+	walk_release(task->parent);
+
+	DIR *dir = fd >= 0 ? fdopendir(fd) : NULL;
+	if (dir == NULL && fd >= 0) {
+		close(fd);
+	}
+	return dir;
+}
+
+/* Reads the directory, unless the cached listing is still valid, and
+ * returns a handle its sub-directories can be opened from */
+static WalkHandle *walk_read(ProjectScan *scan, Arena *arena, WalkTask *task,
+							 const char *path, PathId id, WalkedDir *walked) {
+	DIR *dir = walk_open(task, path);
+	struct stat attr;
+	if (dir == NULL || fstat(dirfd(dir), &attr) != 0) {
+		get_file_stamp(path, &walked->stamp);
+		if (dir != NULL) {
+			closedir(dir);
+		}
+		atomic_store(&walked->done, true);
+		return NULL;
+	}
+
+	file_stamp_from_stat(&attr, &walked->stamp);
+	int item = path_index_get(&scan->cached_index, id);
+	DirListing *cached =
+		item >= 0 ? &at(DirListing, scan->cached, item) : NULL;
+	if (cached != NULL && stamp_equal(&cached->stamp, &walked->stamp)) {
+		walked->cached = cached;
+	} else {
+		read_dir_listing(arena, dir, &walked->files, &walked->dirs);
+	}
+	atomic_store(&walked->done, true);
+
+	WalkHandle *handle = (WalkHandle *)malloc(sizeof(WalkHandle));
+	handle->dir = dir;
+	atomic_init(&handle->refs, 1);
+	return handle;
+}
+
+/* Lists one directory of a rule and submits the sub-directories the rule
+ * descends into. A directory reached by several rules is read by the first
+ * task to get there, the others wait for its listing */
+static void walk_dir(ThreadPool *pool, int worker, void *data, void *ctx) {
+	ProjectScan *scan = (ProjectScan *)ctx;
+	WalkTask *task = (WalkTask *)data;
+	Arena *arena = scan->walk_arenas[worker];
+	char path[BUFFER_SIZE];
+	rule_dir(task->rule, task->rel, path, sizeof(path));
+
+	pthread_mutex_lock(&scan->walk_lock);
+	PathId id = path_intern(path);
+	int item = path_index_get(&scan->walked_index, id);
+	WalkedDir *walked = item >= 0 ? at(WalkedDir *, scan->walked, item) : NULL;
+	bool owner = walked == NULL;
+	if (owner) {
+		walked = (WalkedDir *)arena_alloc(arena, sizeof(WalkedDir));
+		walked->stamp = (FileStamp){0, 0, false};
+		walked->cached = NULL;
+		walked->files = (vector_char_ptr){NULL, 0, 0};
+		walked->dirs = (vector_char_ptr){NULL, 0, 0};
+		atomic_init(&walked->done, false);
+		path_index_put(&scan->walked_index, id, length(scan->walked));
+		append(WalkedDir *, scan->walked, walked);
+	}
+	pthread_mutex_unlock(&scan->walk_lock);
+
+	WalkHandle *handle = NULL;
+	if (owner) {
+		handle = walk_read(scan, arena, task, path, id, walked);
+	} else {
+		walk_release(task->parent);
+		while (!atomic_load(&walked->done)) {
+			sched_yield();
+		}
+	}
+
+	vector_char_ptr *dirs =
+		walked->cached != NULL ? &walked->cached->dirs : &walked->dirs;
+	char child[BUFFER_SIZE];
+	for (size_t i = 0; task->depth != 0 && i < dirs->length; i++) {
+		if (!rule_descends(task->rule, task->rel, dirs->items[i], child,
+						   sizeof(child))) {
+			continue;
+		}
+		WalkTask *sub = (WalkTask *)arena_alloc(arena, sizeof(WalkTask));
+		sub->rule = task->rule;
+		sub->rel = string(string_from(arena, child));
+		sub->depth = task->depth > 0 ? task->depth - 1 : -1;
+		sub->parent = handle;
+		if (handle != NULL) {
+			atomic_fetch_add(&handle->refs, 1);
+		}
+		thread_pool_submit(pool, worker, sub);
+	}
+	walk_release(handle);
+}
+
+/* Lists every directory the rules reach on a pool of threads, so collecting
+ * the files afterwards finds all of them already listed. Reads mostly wait
+ * on the file system, hence more threads than CPUs */
+static void walk_rules(ProjectScan *scan, Vector *rules) {
+	if (length(rules) == 0) {
+		return;
+	}
+
+	int workers = get_cpu_count() * 2;
+	if (workers > DIR_WALK_MAX_THREADS) {
+		workers = DIR_WALK_MAX_THREADS;
+	}
+	scan->walk_workers = workers;
+	scan->walk_arenas = (Arena **)malloc(sizeof(Arena *) * workers);
+	for (int i = 0; i < workers; i++) {
+		scan->walk_arenas[i] = arena_init(BUFFER_SIZE);
+	}
+
+	ThreadPool *pool = thread_pool_init(workers, walk_dir, scan);
+	for (int i = 0; i < length(rules); i++) {
+		ScanRule *rule = &at(ScanRule, rules, i);
+		WalkTask *task = (WalkTask *)arena_alloc(scan->walk_arenas[0],
+												 sizeof(WalkTask));
+		task->rule = rule;
+		task->rel = rule->base;
+		task->depth = rule->depth;
+		task->parent = NULL;
+		thread_pool_submit(pool, 0, task);
+	}
+	thread_pool_run(pool);
+	thread_pool_free(pool);
+}
+
+/* Prepares a rule for a manifest entry, which is either a directory, whose
+ * files are taken, or a glob pattern where `**` matches any number of
+ * directories. The walk starts from the pattern's leading directories that
+ * have no wildcards */
+static void rule_prepare(Arena *arena, ScanRule *rule, char *entry) {
+	char pattern[BUFFER_SIZE];
+	while (strncmp(entry, "./", 2) == 0) {
+		entry += 2;
+	}
+	if (has_glob(entry)) {
+		snprintf(pattern, sizeof(pattern), "%s", entry);
+	} else {
+		size_t len = strlen(entry);
+		while (len > 1 && entry[len - 1] == '/') {
+			len--;
+		}
+		snprintf(pattern, sizeof(pattern), "%.*s/*", (int)len, entry);
+	}
+
+	char base[BUFFER_SIZE] = "";
+	char seg[BUFFER_SIZE];
+	size_t base_len = 0;
+	int depth = 0;
+	bool literal = true;
+	StrView rest = strview_from(pattern);
+	StrView segment;
+	while (strview_split_next(&rest, '/', &segment)) {
+		snprintf(seg, sizeof(seg), "%.*s", (int)segment.len, segment.ptr);
+		if (literal && !has_glob(seg) && rest.len > 0) {
+			/* an empty first segment is the root of an absolute path */
+			const char *sep = base_len == 0 && segment.len > 0 ? "" : "/";
+			if (base_len > 0 && base[base_len - 1] == '/') {
+				sep = "";
+			}
+			base_len += snprintf(base + base_len, sizeof(base) - base_len,
+								 "%s%s", sep, seg);
+			continue;
+		}
+		literal = false;
+		if (strcmp(seg, "**") == 0) {
+			depth = -1;
+		} else if (depth >= 0) {
+			depth++;
+		}
+	}
+
+	rule->pattern = string(string_from(arena, pattern));
+	rule->base = string(string_from(arena, base));
+	rule->depth = depth > 0 ? depth - 1 : depth;
+}
+
+/* Adds a rule of one kind for every entry listed under `key`, for the
+ * project first and then for every dependency */
+static void add_manifest_rules(Arena *arena, ProjectModel *model,
+							   Vector *rules, Vector *out, yyjson_val *root,
+							   yyjson_val *deps, const char *key, int kind) {
+	size_t idx, max;
+	yyjson_val *val;
+	ScanRule rule = {"", NULL, NULL, 0, yyjson_obj_get(root, "exclude"),
+					 kind, out};
+
+	yyjson_arr_foreach(yyjson_obj_get(root, key), idx, max, val) {
+		rule_prepare(arena, &rule, json_str(val));
+		append(ScanRule, rules, rule);
+	}
+
+	yyjson_val *dep_name, *dep_obj;
+	yyjson_obj_foreach(deps, idx, max, dep_name, dep_obj) {
+		size_t dir_idx, dir_max;
+		rule.root = string(string_concat_cstr(arena, 3, model->cwd, "/deps/",
+											  json_str(dep_name)));
+		rule.exclude = yyjson_obj_get(dep_obj, "exclude");
+		yyjson_arr_foreach(yyjson_obj_get(dep_obj, key), dir_idx, dir_max,
+						   val) {
+			rule_prepare(arena, &rule, json_str(val));
+			append(ScanRule, rules, rule);
+		}
+	}
+}
+
+static void append_json_strings(Arena *arena, Vector *out, yyjson_val *arr) {
+	size_t idx, max;
+	yyjson_val *val;
+	yyjson_arr_foreach(arr, idx, max, val) {
+		append(char *, out, string(string_from(arena, json_str(val))));
+	}
+}
+
+static ProjectModel *project_model_new(Arena *arena) {
+	ProjectModel *model =
+		(ProjectModel *)arena_alloc(arena, sizeof(ProjectModel));
+	model->cwd = NULL;
+	model->name = NULL;
+	model->compiler = NULL;
+	model->static_link = NULL;
+	model->is_exec = false;
+	model->include_dirs = vector_init(char *);
+	model->flags = vector_init(char *);
+	model->lib_links = vector_init(char *);
+	model->sources = vector_init(char *);
+	model->headers = vector_init(char *);
+	model->stat_libs = vector_init(char *);
+	model->shared_libs = vector_init(char *);
+	model->dependencies = vector_init(char *);
+	model->dep_versions = vector_init(char *);
+	model->watched = vector_init(WatchedPath);
+	model->snapshot = NULL;
+	return model;
+}
+
+static ProjectModel *project_model_resolve(Arena *arena, char *cwd) {
+	yyjson_read_err err;
+	yyjson_doc *doc = yyjson_read_file(PROJECT_MANIFEST, 0, NULL, &err);
+	if (!doc) {
+		fprintf(stderr, "Read error: %s\n", err.msg);
+		return NULL;
+	}
+
+	ProjectModel *model = project_model_new(arena);
+	ProjectScan scan;
+	scan.listings = vector_init(DirListing);
+	scan.listed = (PathIndex){NULL, 0};
+	scan.cached = vector_init(DirListing);
+	scan.cached_index = (PathIndex){NULL, 0};
+	scan.cache_buffer = NULL;
+	scan.collected = (PathIndex){NULL, 0};
+	pthread_mutex_init(&scan.walk_lock, NULL);
+	scan.walked = vector_init(WalkedDir *);
+	scan.walked_index = (PathIndex){NULL, 0};
+	scan.walk_arenas = NULL;
+	scan.walk_workers = 0;
+	dir_index_load(&scan, DIR_INDEX_PATH);
+	yyjson_val *root = yyjson_doc_get_root(doc);
+	yyjson_val *deps = yyjson_obj_get(root, "dependencies");
+
+	model->cwd = cwd;
+	watch_path(arena, model, PROJECT_MANIFEST, NULL);
+
+	model->name = string(
+		string_from(arena, json_str(yyjson_obj_get(root, "project_name"))));
+	model->compiler = string(
+		string_from(arena, json_str(yyjson_obj_get(root, "compiler_path"))));
+	model->is_exec = yyjson_get_bool(yyjson_obj_get(root, "executable"));
+
+	/* "extract" (default), "archive" or "whole-archive" */
+	yyjson_val *static_link = yyjson_obj_get(root, "static_link");
+	model->static_link =
+		string(string_from(arena, yyjson_is_str(static_link)
+									  ? json_str(static_link)
+									  : "extract"));
+
+	append_json_strings(arena, model->include_dirs,
+						yyjson_obj_get(root, "include_paths"));
+	size_t idx, max;
+	yyjson_val *dep_name, *dep_obj;
+	yyjson_obj_foreach(deps, idx, max, dep_name, dep_obj) {
+		yyjson_val *version = yyjson_obj_get(dep_obj, "version");
+		append(char *, model->dependencies,
+			   string(string_from(arena, json_str(dep_name))));
+		append(char *, model->dep_versions,
+			   string(string_from(arena, yyjson_is_str(version)
+											 ? json_str(version)
+											 : "")));
+		size_t inc_idx, inc_max;
+		yyjson_val *val;
+		yyjson_arr_foreach(yyjson_obj_get(dep_obj, "include_paths"), inc_idx,
+						   inc_max, val) {
+			append(char *, model->include_dirs,
+				   string(string_concat_cstr(arena, 4, "deps/",
+											 json_str(dep_name), "/",
+											 json_str(val))));
+		}
+	}
+	append_json_strings(arena, model->flags, yyjson_obj_get(root, "flags"));
+	append_json_strings(arena, model->lib_links,
+						yyjson_obj_get(root, "lib_links"));
+
+	Vector *rules = vector_init(ScanRule);
+	add_manifest_rules(arena, model, rules, model->sources, root, deps, "src",
+					   KIND_SOURCE);
+	if (!model->is_exec) {
+		add_manifest_rules(arena, model, rules, model->headers, root, deps,
+						   "include_paths", KIND_HEADER);
+	}
+	add_manifest_rules(arena, model, rules, model->stat_libs, root, deps,
+					   "static_lib", KIND_STATIC);
+	add_manifest_rules(arena, model, rules, model->shared_libs, root, deps,
+					   "shared_lib", KIND_SHARED);
+	walk_rules(&scan, rules);
+	for (int i = 0; i < length(rules); i++) {
+		ScanRule *rule = &at(ScanRule, rules, i);
+		scan_dir(arena, model, &scan, rule, rule->base, rule->depth);
+	}
+	vector_free(rules);
+
+	/* the `static` and `shared` directories are used when nothing was
+	 * found in the configured ones */
+	ScanRule rule = {"", NULL, NULL, 0, NULL, KIND_STATIC, model->stat_libs};
+	if (length(model->stat_libs) == 0) {
+		rule_prepare(arena, &rule,
+					 string(string_concat_cstr(arena, 2, cwd, "/static")));
+		scan_dir(arena, model, &scan, &rule, rule.base, rule.depth);
+	}
+	rule.kind = KIND_SHARED;
+	rule.out = model->shared_libs;
+	if (length(model->shared_libs) == 0) {
+		rule_prepare(arena, &rule,
+					 string(string_concat_cstr(arena, 2, cwd, "/shared")));
+		scan_dir(arena, model, &scan, &rule, rule.base, rule.depth);
+	}
+
+	if (directory_exists("./build/.cache")) {
+		dir_index_save(&scan, DIR_INDEX_PATH);
+	}
+	for (int i = 0; i < length(scan.listings); i++) {
+		vector_char_ptr_free(&at(DirListing, scan.listings, i).files);
+		vector_char_ptr_free(&at(DirListing, scan.listings, i).dirs);
+	}
+	for (int i = 0; i < length(scan.cached); i++) {
+		vector_char_ptr_free(&at(DirListing, scan.cached, i).files);
+		vector_char_ptr_free(&at(DirListing, scan.cached, i).dirs);
+	}
+	for (int i = 0; i < length(scan.walked); i++) {
+		vector_char_ptr_free(&at(WalkedDir *, scan.walked, i)->files);
+		vector_char_ptr_free(&at(WalkedDir *, scan.walked, i)->dirs);
+	}
+	for (int i = 0; i < scan.walk_workers; i++) {
+		arena_free(&scan.walk_arenas[i]);
+	}
+	free(scan.walk_arenas);
+	vector_free(scan.listings);
+	vector_free(scan.cached);
+	vector_free(scan.walked);
+	path_index_free(&scan.walked_index);
+	pthread_mutex_destroy(&scan.walk_lock);
+	path_index_free(&scan.listed);
+	path_index_free(&scan.cached_index);
+	path_index_free(&scan.collected);
+	free(scan.cache_buffer);
+	yyjson_doc_free(doc);
+	return model;
+}
+
+static void project_model_save(ProjectModel *model, const char *path) {
+	char tmp_path[BUFFER_SIZE];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE *out = fopen(tmp_path, "wb");
+	if (out == NULL) {
+		return;
+	}
+
+	uint32_t version = PROJECT_MODEL_VERSION;
+	int err = fwrite(PROJECT_MODEL_MAGIC, 1, 8, out) != 8 ||
+			  write_u32(out, version) || write_str(out, model->cwd) ||
+			  write_str(out, model->name) || write_str(out, model->compiler) ||
+			  write_str(out, model->static_link) ||
+			  write_u32(out, model->is_exec);
+
+	err = err || write_u32(out, length(model->watched));
+	for (int i = 0; i < length(model->watched) && !err; i++) {
+		WatchedPath *watched = &at(WatchedPath, model->watched, i);
+		err = write_str(out, watched->path) ||
+			  fwrite(&watched->stamp, sizeof(FileStamp), 1, out) != 1;
+	}
+
+	err = err || write_list(out, model->include_dirs) ||
+		  write_list(out, model->flags) || write_list(out, model->lib_links) ||
+		  write_list(out, model->sources) || write_list(out, model->headers) ||
+		  write_list(out, model->stat_libs) ||
+		  write_list(out, model->shared_libs) ||
+		  write_list(out, model->dependencies) ||
+		  write_list(out, model->dep_versions);
+
+	if (fclose(out) != 0 || err || rename(tmp_path, path) != 0) {
+		unlink(tmp_path);
+	}
+}
+
+/* Loads the snapshot, NULL when it is missing, unreadable or stale */
+static ProjectModel *project_model_load_snapshot(Arena *arena,
+												 const char *path, char *cwd) {
+	FILE *in = fopen(path, "rb");
+	if (in == NULL) {
+		return NULL;
+	}
+	struct stat attr;
+	if (fstat(fileno(in), &attr) != 0) {
+		fclose(in);
+		return NULL;
+	}
+
+	char *buffer = (char *)malloc(attr.st_size + 1);
+	if (buffer == NULL ||
+		fread(buffer, 1, attr.st_size, in) != (size_t)attr.st_size) {
+		free(buffer);
+		fclose(in);
+		return NULL;
+	}
+	fclose(in);
+
+	ProjectModel *model = project_model_new(arena);
+	model->snapshot = buffer;
+
+	SnapshotReader reader = {buffer, buffer + attr.st_size, true};
+	char *magic = (char *)read_bytes(&reader, 8);
+	if (magic == NULL || memcmp(magic, PROJECT_MODEL_MAGIC, 8) != 0 ||
+		read_u32(&reader) != PROJECT_MODEL_VERSION) {
+		goto STALE;
+	}
+
+	model->cwd = read_str(&reader);
+	if (!reader.ok || strcmp(model->cwd, cwd) != 0) {
+		goto STALE;
+	}
+	model->name = read_str(&reader);
+	model->compiler = read_str(&reader);
+	model->static_link = read_str(&reader);
+	model->is_exec = read_u32(&reader) != 0;
+
+	uint32_t watched_count = read_u32(&reader);
+	for (uint32_t i = 0; i < watched_count && reader.ok; i++) {
+		WatchedPath watched;
+		FileStamp current;
+		watched.path = read_str(&reader);
+		void *stamp = read_bytes(&reader, sizeof(FileStamp));
+		if (stamp == NULL) {
+			goto STALE;
+		}
+		memcpy(&watched.stamp, stamp, sizeof(FileStamp));
+
+		get_file_stamp(watched.path, &current);
+		if (current.exists != watched.stamp.exists ||
+			current.mtime != watched.stamp.mtime ||
+			current.size != watched.stamp.size) {
+			goto STALE;
+		}
+		append(WatchedPath, model->watched, watched);
+	}
+
+	read_list(&reader, model->include_dirs);
+	read_list(&reader, model->flags);
+	read_list(&reader, model->lib_links);
+	read_list(&reader, model->sources);
+	read_list(&reader, model->headers);
+	read_list(&reader, model->stat_libs);
+	read_list(&reader, model->shared_libs);
+	read_list(&reader, model->dependencies);
+	read_list(&reader, model->dep_versions);
+	if (reader.ok && reader.pos == reader.end) {
+		return model;
+	}
+
+STALE:
+	project_model_free(model);
+	return NULL;
+}
+
+/* A directory changed within the last second could change again without its
+ * mtime moving, such a model isn't worth saving */
+static bool project_model_is_racy(ProjectModel *model) {
+	long long recent = ((long long)time(NULL) - 1) * 1000000000LL;
+	for (int i = 0; i < length(model->watched); i++) {
+		if (at(WatchedPath, model->watched, i).stamp.mtime >= recent) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Returns the resolved project, from the snapshot when nothing it was built
+ * from changed. `build`, `run` and `gen` all start from here */
+ProjectModel *project_model_load(Arena *arena) {
+	char *cwd = string(get_current_working_dir(arena));
+
+	ProjectModel *model =
+		project_model_load_snapshot(arena, PROJECT_MODEL_PATH, cwd);
+	if (model != NULL) {
+		return model;
+	}
+
+	model = project_model_resolve(arena, cwd);
+	if (model != NULL && directory_exists("./build/.cache") &&
+		!project_model_is_racy(model)) {
+		project_model_save(model, PROJECT_MODEL_PATH);
+	}
+	return model;
+}
+
+void project_model_free(ProjectModel *model) {
+	vector_free(model->include_dirs);
+	vector_free(model->flags);
+	vector_free(model->lib_links);
+	vector_free(model->sources);
+	vector_free(model->headers);
+	vector_free(model->stat_libs);
+	vector_free(model->shared_libs);
+	vector_free(model->dependencies);
+	vector_free(model->dep_versions);
+	vector_free(model->watched);
+	free(model->snapshot);
+	model->snapshot = NULL;
+}
@@ -0,0 +1,554 @@
+#include <mybuild.h>
+
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+/*
+ * Remote side of the compile cache, over plain HTTP:
+ *
+ *   GET <url>/<kind>/<key>   200 with the blob, 404 when it's missing
+ *   PUT <url>/<kind>/<key>   stores the blob, answered with any 2xx
+ *
+ * Kinds and keys are the local cache's: "m" for manifests and "r" for
+ * results, keys are 16 hex digits. Blobs are "MBLZ", the size of the data
+ * as a u64 and the data compressed as an LZ4 block.
+ *
+ * Every request uses its own connection. Once a request fails or times out
+ * the remote is left alone for the rest of the build and everything that
+ * misses locally is compiled.
+ * */
+
+#define REMOTE_BLOB_MAGIC "MBLZ"
+#define REMOTE_BLOB_HEADER 12
+#define REMOTE_DEFAULT_TIMEOUT 2000
+#define REMOTE_MAX_BLOB ((size_t)256 << 20)
+#define REMOTE_DEFAULT_PORT "8080"
+
+struct RemoteCache {
+	char *url;
+	char *host;
+	char *port;
+	char *prefix;
+	int timeout_ms;
+	bool writable;
+	bool failed;
+};
+
+/* Accepts http://host[:port][/prefix], with [] around IPv6 addresses */
+static bool remote_parse_url(Arena *arena, RemoteCache *remote, char *url) {
+	if (strncmp(url, "http://", 7) != 0) {
+		return false;
+	}
+	char *host = url + 7;
+	char *host_end;
+	if (host[0] == '[') {
+		host++;
+		host_end = strchr(host, ']');
+		if (host_end == NULL) {
+			return false;
+		}
+	} else {
+		host_end = host + strcspn(host, ":/");
+	}
+	char *rest = host_end + (*host_end == ']');
+
+	char *path = strchr(rest, '/');
+	if (path == NULL) {
+		path = rest + strlen(rest);
+	}
+	String *tail = string_from(arena, host);
+	remote->host = string(string_sub(arena, tail, 0, host_end - host));
+	remote->port = rest[0] == ':' ? string(string_sub(arena, tail,
+													  rest + 1 - host,
+													  path - host))
+								  : REMOTE_DEFAULT_PORT;
+	size_t path_len = strlen(path);
+	while (path_len > 0 && path[path_len - 1] == '/') {
+		path_len--;
+	}
+	remote->prefix = string(
+		string_sub(arena, tail, path - host, path - host + path_len));
+	return remote->host[0] != '\0' && remote->port[0] != '\0';
+}
+
+/* Configured by $MYBUILD_REMOTE_CACHE (the URL),
+ * $MYBUILD_REMOTE_CACHE_MODE ("read-only", the default, or "read-write")
+ * and $MYBUILD_REMOTE_CACHE_TIMEOUT (milliseconds). NULL when unset */
+RemoteCache *remote_cache_open(Arena *arena) {
+	char *url = getenv("MYBUILD_REMOTE_CACHE");
+	if (url == NULL || url[0] == '\0') {
+		return NULL;
+	}
+
+	RemoteCache *remote = (RemoteCache *)arena_alloc(arena, sizeof(*remote));
+	if (!remote_parse_url(arena, remote, url)) {
+		fprintf(stderr, "Invalid remote cache URL '%s', expected "
+						"http://host[:port][/path]\n",
+				url);
+		return NULL;
+	}
+	char *mode = getenv("MYBUILD_REMOTE_CACHE_MODE");
+	char *timeout = getenv("MYBUILD_REMOTE_CACHE_TIMEOUT");
+	remote->url = url;
+	remote->writable = mode != NULL && STR_CMP(mode, "read-write") == 0;
+	remote->timeout_ms = timeout != NULL && atoi(timeout) > 0
+							 ? atoi(timeout)
+							 : REMOTE_DEFAULT_TIMEOUT;
+	remote->failed = false;
+	return remote;
+}
+
+bool remote_cache_writable(RemoteCache *remote) {
+	return remote->writable && !remote->failed;
+}
+
+static void remote_fail(RemoteCache *remote, const char *reason) {
+	if (!remote->failed) {
+		fprintf(stderr, "Remote cache '%s' %s, compiling locally\n",
+				remote->url, reason);
+	}
+	remote->failed = true;
+}
+
+static void set_timeouts(int fd, int timeout_ms) {
+	struct timeval tv;
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+/* Connects within the timeout, -1 on failure */
+static int remote_connect(RemoteCache *remote) {
+	struct addrinfo hints, *addrs;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(remote->host, remote->port, &hints, &addrs) != 0) {
+		return -1;
+	}
+
+	int fd = -1;
+	for (struct addrinfo *ai = addrs; ai != NULL && fd < 0; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC,
+					ai->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+		int flags = fcntl(fd, F_GETFL);
+		fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+		int err = connect(fd, ai->ai_addr, ai->ai_addrlen);
+		if (err != 0 && errno == EINPROGRESS) {
+			struct pollfd pfd = {fd, POLLOUT, 0};
+			socklen_t len = sizeof(err);
+			if (poll(&pfd, 1, remote->timeout_ms) != 1 ||
+				getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+				err = -1;
+			}
+		}
+		if (err != 0) {
+			close(fd);
+			fd = -1;
+			continue;
+		}
+		fcntl(fd, F_SETFL, flags);
+		set_timeouts(fd, remote->timeout_ms);
+	}
+	freeaddrinfo(addrs);
+	return fd;
+}
+
+static int send_all(int fd, const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			continue;
+		}
+		if (sent <= 0) {
+			return 1;
+		}
+		data += sent;
+		len -= sent;
+	}
+	return 0;
+}
+
+/* Reads until the peer closes the connection, or `limit` bytes. The data
+ * is malloc'd and NUL terminated */
+static char *recv_all(int fd, size_t limit, size_t *len) {
+	size_t capacity = BUFFER_SIZE;
+	char *data = (char *)malloc(capacity + 1);
+	*len = 0;
+	for (;;) {
+		if (*len == capacity) {
+			if (capacity >= limit) {
+				free(data);
+				return NULL;
+			}
+			capacity *= 2;
+			data = (char *)realloc(data, capacity + 1);
+		}
+		ssize_t got = recv(fd, data + *len, capacity - *len, 0);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got < 0) {
+			free(data);
+			return NULL;
+		}
+		if (got == 0) {
+			break;
+		}
+		*len += got;
+	}
+	data[*len] = '\0';
+	return data;
+}
+
+/* Content-Length of a header block, -1 when absent */
+static long long header_content_length(char *headers) {
+	for (char *line = strstr(headers, "\r\n"); line != NULL;
+		 line = strstr(line + 2, "\r\n")) {
+		if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+			return atoll(line + 17);
+		}
+	}
+	return -1;
+}
+
+/* Sends one request, returns the HTTP status or -1 when the exchange
+ * failed. A 200 response's body is returned in `body`, malloc'd */
+static int remote_request(RemoteCache *remote, const char *method,
+						  const char *kind, uint64_t key, const char *data,
+						  size_t len, char **body, size_t *body_len) {
+	char request[BUFFER_SIZE];
+	int request_len = snprintf(
+		request, sizeof(request),
+		"%s %s/%s/%016llx HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n"
+		"Content-Length: %zu\r\n\r\n",
+		method, remote->prefix, kind, (unsigned long long)key, remote->host,
+		len);
+	if (request_len >= (int)sizeof(request)) {
+		return -1;
+	}
+
+	int fd = remote_connect(remote);
+	if (fd < 0) {
+		return -1;
+	}
+	size_t response_len;
+	char *response = NULL;
+	if (send_all(fd, request, request_len) == 0 &&
+		send_all(fd, data, len) == 0) {
+		response = recv_all(fd, REMOTE_MAX_BLOB + BUFFER_SIZE, &response_len);
+	}
+	close(fd);
+
+	int status = -1;
+	char *headers_end =
+		response != NULL ? strstr(response, "\r\n\r\n") : NULL;
+	if (headers_end == NULL ||
+		sscanf(response, "HTTP/%*d.%*d %d", &status) != 1) {
+		free(response);
+		return -1;
+	}
+	*headers_end = '\0';
+	char *content = headers_end + 4;
+	size_t content_len = response_len - (content - response);
+	long long expected = header_content_length(response);
+	if (expected >= 0 && (size_t)expected != content_len) {
+		/* cut short */
+		status = -1;
+	}
+
+	if (status == 200 && body != NULL) {
+		*body = (char *)malloc(content_len + 1);
+		memcpy(*body, content, content_len);
+		*body_len = content_len;
+	}
+	free(response);
+	return status;
+}
+
+/* Fetches an entry, NULL when it's missing or the remote failed. The data
+ * is allocated in `arena` */
+char *remote_cache_get(RemoteCache *remote, Arena *arena, const char *kind,
+					   uint64_t key, size_t *len) {
+	if (remote->failed) {
+		return NULL;
+	}
+
+	char *blob = NULL;
+	size_t blob_len = 0;
+	int status = remote_request(remote, "GET", kind, key, NULL, 0, &blob,
+								&blob_len);
+	if (status == 404) {
+		return NULL;
+	}
+	if (status != 200) {
+		remote_fail(remote, status < 0 ? "unreachable" : "failed");
+		return NULL;
+	}
+
+	char *data = NULL;
+	uint64_t size;
+	if (blob_len >= REMOTE_BLOB_HEADER &&
+		memcmp(blob, REMOTE_BLOB_MAGIC, 4) == 0) {
+		memcpy(&size, blob + 4, sizeof(size));
+		data = size <= REMOTE_MAX_BLOB
+				   ? (char *)arena_alloc_aligned(arena, size + 1, 1)
+				   : NULL;
+	}
+	if (data != NULL &&
+		!lz_decompress(blob + REMOTE_BLOB_HEADER, blob_len - REMOTE_BLOB_HEADER,
+					   data, size)) {
+		/* a corrupt entry is a miss */
+		data = NULL;
+	}
+	free(blob);
+	if (data != NULL) {
+		data[size] = '\0';
+		*len = size;
+	}
+	return data;
+}
+
+void remote_cache_put(RemoteCache *remote, const char *kind, uint64_t key,
+					  const char *data, size_t len) {
+	if (!remote_cache_writable(remote)) {
+		return;
+	}
+
+	uint64_t size = len;
+	char *blob = (char *)malloc(REMOTE_BLOB_HEADER + lz_bound(len));
+	memcpy(blob, REMOTE_BLOB_MAGIC, 4);
+	memcpy(blob + 4, &size, sizeof(size));
+	size_t blob_len =
+		REMOTE_BLOB_HEADER + lz_compress(data, len, blob + REMOTE_BLOB_HEADER);
+
+	int status =
+		remote_request(remote, "PUT", kind, key, blob, blob_len, NULL, NULL);
+	free(blob);
+	if (status < 200 || status > 299) {
+		remote_fail(remote, status < 0 ? "unreachable" : "rejected an upload");
+	}
+}
+
+typedef struct {
+	int fd;
+	char *dir;
+} ServerConnection;
+
+static void server_respond(int fd, int status, const char *reason,
+						   const char *body, size_t len) {
+	char header[256];
+	int header_len = snprintf(header, sizeof(header),
+							  "HTTP/1.1 %d %s\r\nContent-Length: %zu\r\n"
+							  "Connection: close\r\n\r\n",
+							  status, reason, len);
+	if (send_all(fd, header, header_len) == 0 && len > 0) {
+		send_all(fd, body, len);
+	}
+}
+
+/* The `<kind>/<key>` at the end of a request path, anything before it is
+ * the client's prefix. False for anything else, so requests can't reach
+ * outside the store */
+static bool server_entry(char *path, char *kind, char *key) {
+	size_t len = strlen(path);
+	if (len < 19 || path[len - 17] != '/' || path[len - 19] != '/' ||
+		(path[len - 18] != 'm' && path[len - 18] != 'r')) {
+		return false;
+	}
+	for (size_t i = len - 16; i < len; i++) {
+		if (!isxdigit((unsigned char)path[i])) {
+			return false;
+		}
+	}
+	*kind = path[len - 18];
+	memcpy(key, path + len - 16, 16);
+	key[16] = '\0';
+	return true;
+}
+
+static void *server_handle(void *data) {
+	ServerConnection *conn = (ServerConnection *)data;
+	char request[BUFFER_SIZE + 1];
+	size_t len = 0;
+	char *headers_end = NULL;
+
+	while (headers_end == NULL && len < BUFFER_SIZE) {
+		ssize_t got = recv(conn->fd, request + len, BUFFER_SIZE - len, 0);
+		if (got <= 0) {
+			goto CLEANUP;
+		}
+		len += got;
+		request[len] = '\0';
+		headers_end = strstr(request, "\r\n\r\n");
+	}
+	if (headers_end == NULL) {
+		server_respond(conn->fd, 431, "Request Header Fields Too Large", NULL,
+					   0);
+		goto CLEANUP;
+	}
+
+	char method[8], path[1024], kind, key[17], file[BUFFER_SIZE];
+	if (sscanf(request, "%7s %1023s HTTP/", method, path) != 2 ||
+		!server_entry(path, &kind, key)) {
+		server_respond(conn->fd, 400, "Bad Request", NULL, 0);
+		goto CLEANUP;
+	}
+	snprintf(file, sizeof(file), "%s/%c/%.2s/%s", conn->dir, kind, key, key);
+
+	if (strcmp(method, "GET") == 0) {
+		FILE *in = fopen(file, "rb");
+		struct stat attr;
+		if (in == NULL || fstat(fileno(in), &attr) != 0) {
+			if (in != NULL) {
+				fclose(in);
+			}
+			server_respond(conn->fd, 404, "Not Found", NULL, 0);
+			goto CLEANUP;
+		}
+		char *blob = (char *)malloc(attr.st_size + 1);
+		size_t blob_len = fread(blob, 1, attr.st_size, in);
+		fclose(in);
+		server_respond(conn->fd, 200, "OK", blob, blob_len);
+		free(blob);
+	} else if (strcmp(method, "PUT") == 0) {
+		*headers_end = '\0';
+		long long expected = header_content_length(request);
+		if (expected < 0 || (size_t)expected > REMOTE_MAX_BLOB) {
+			server_respond(conn->fd, 411, "Length Required", NULL, 0);
+			goto CLEANUP;
+		}
+
+		char *blob = (char *)malloc(expected + 1);
+		size_t have = len - (headers_end + 4 - request);
+		memcpy(blob, headers_end + 4, have);
+		while (have < (size_t)expected) {
+			ssize_t got = recv(conn->fd, blob + have, expected - have, 0);
+			if (got <= 0) {
+				break;
+			}
+			have += got;
+		}
+
+		char tmp[BUFFER_SIZE + 32];
+		snprintf(file, sizeof(file), "%s/%c/%.2s", conn->dir, kind, key);
+		MAKE_DIR(file);
+		snprintf(file, sizeof(file), "%s/%c/%.2s/%s", conn->dir, kind, key,
+				 key);
+		snprintf(tmp, sizeof(tmp), "%s.%lx.tmp", file,
+				 (unsigned long)pthread_self());
+		FILE *out = have == (size_t)expected ? fopen(tmp, "wb") : NULL;
+		bool stored = out != NULL && fwrite(blob, 1, have, out) == have;
+		if (out != NULL && (fclose(out) != 0 || !stored ||
+							rename(tmp, file) != 0)) {
+			unlink(tmp);
+			stored = false;
+		}
+		free(blob);
+		if (stored) {
+			server_respond(conn->fd, 201, "Created", NULL, 0);
+		} else {
+			server_respond(conn->fd, 500, "Internal Server Error", NULL, 0);
+		}
+	} else {
+		server_respond(conn->fd, 405, "Method Not Allowed", NULL, 0);
+	}
+
+CLEANUP:
+	close(conn->fd);
+	free(conn);
+	return NULL;
+}
+
+/* `myBuild cache serve [--port N] [--bind ADDR] [--dir DIR]`, a minimal
+ * reference server for the protocol above. Entries are stored as received,
+ * one thread per connection */
+int remote_cache_serve(char *default_dir, int argc, char *argv[]) {
+	char *port = REMOTE_DEFAULT_PORT;
+	char *bind_addr = "127.0.0.1";
+	char *dir = default_dir;
+	for (int i = 0; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--port") == 0) {
+			port = argv[i + 1];
+		} else if (strcmp(argv[i], "--bind") == 0) {
+			bind_addr = argv[i + 1];
+		} else if (strcmp(argv[i], "--dir") == 0) {
+			dir = argv[i + 1];
+		} else {
+			break;
+		}
+	}
+	if (argc % 2 != 0) {
+		printf("Usage: myBuild cache serve [--port N] [--bind ADDR] "
+			   "[--dir DIR]\n");
+		return 1;
+	}
+
+	char path[BUFFER_SIZE];
+	MAKE_DIR(dir);
+	snprintf(path, sizeof(path), "%s/m", dir);
+	MAKE_DIR(path);
+	snprintf(path, sizeof(path), "%s/r", dir);
+	MAKE_DIR(path);
+	if (!directory_exists(path)) {
+		fprintf(stderr, "Unable to create '%s'\n", dir);
+		return 1;
+	}
+
+	struct addrinfo hints, *addr;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(bind_addr, port, &hints, &addr) != 0) {
+		fprintf(stderr, "Unable to resolve '%s'\n", bind_addr);
+		return 1;
+	}
+	int one = 1;
+	int server = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC,
+						addr->ai_protocol);
+	if (server < 0 ||
+		setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+		bind(server, addr->ai_addr, addr->ai_addrlen) != 0 ||
+		listen(server, 64) != 0) {
+		perror("Unable to start the cache server");
+		freeaddrinfo(addr);
+		return 1;
+	}
+	freeaddrinfo(addr);
+
+	signal(SIGPIPE, SIG_IGN);
+	printf("[✓] Serving '%s' on http://%s:%s\n", dir, bind_addr, port);
+	fflush(stdout);
+
+	for (;;) {
+		int fd = accept(server, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED || errno == EMFILE) {
+				continue;
+			}
+			perror("accept failed");
+			break;
+		}
+		set_timeouts(fd, 30000);
+
+		ServerConnection *conn =
+			(ServerConnection *)malloc(sizeof(ServerConnection));
+		conn->fd = fd;
+		conn->dir = dir;
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, server_handle, conn) != 0) {
+			server_handle(conn);
+		} else {
+			pthread_detach(thread);
+		}
+	}
+	close(server);
+	return 1;
+}
@@ -0,0 +1,66 @@
+#include <mybuild.h>
+
+typedef struct {
+	FileStamp stamp;
+	bool cached;
+} StatEntry;
+
+/* Process wide interned path -> stamp table, so every file is stat'ed at most
+ * once per invocation no matter how many translation units include it */
+static struct {
+	StatEntry *entries;
+	size_t capacity;
+	long hits;
+	long misses;
+} cache;
+
+bool stat_cache_get(PathId path, FileStamp *stamp) {
+	if (path >= cache.capacity) {
+		size_t capacity = cache.capacity ? cache.capacity : 1024;
+		while (capacity <= path) {
+			capacity *= 2;
+		}
+		cache.entries =
+			(StatEntry *)realloc(cache.entries, sizeof(StatEntry) * capacity);
+		memset(cache.entries + cache.capacity, 0,
+			   sizeof(StatEntry) * (capacity - cache.capacity));
+		cache.capacity = capacity;
+	}
+
+	StatEntry *entry = &cache.entries[path];
+	if (entry->cached) {
+		cache.hits++;
+	} else {
+		cache.misses++;
+		get_file_stamp(path_str(path), &entry->stamp);
+		entry->cached = true;
+	}
+
+	*stamp = entry->stamp;
+	return stamp->exists;
+}
+
+long long stat_cache_mtime(PathId path) {
+	FileStamp stamp;
+	stat_cache_get(path, &stamp);
+	return stamp.mtime;
+}
+
+void stat_cache_invalidate(PathId path) {
+	if (path < cache.capacity && cache.entries[path].cached) {
+		get_file_stamp(path_str(path), &cache.entries[path].stamp);
+	}
+}
+
+void stat_cache_stats(long *hits, long *misses) {
+	*hits = cache.hits;
+	*misses = cache.misses;
+}
+
+void stat_cache_free() {
+	free(cache.entries);
+	cache.entries = NULL;
+	cache.capacity = 0;
+	cache.hits = 0;
+	cache.misses = 0;
+}
@@ -0,0 +1,184 @@
+#include <mybuild.h>
+
+#include <stdatomic.h>
+
+/*
+ * Work-stealing pool of threads for in-process work. Every worker owns a
+ * deque: it pushes and pops the tasks it creates at the back, so it works
+ * depth-first, while idle workers steal from the front of the others. The
+ * thread calling thread_pool_run is worker 0.
+ * */
+
+typedef struct {
+	pthread_mutex_t lock;
+	void **tasks;
+	size_t head;
+	size_t tail;
+	size_t capacity;
+} TaskDeque;
+
+struct ThreadPool {
+	TaskDeque *deques;
+	int workers;
+	ThreadTaskFn run;
+	void *ctx;
+	/* submitted tasks that didn't finish yet */
+	atomic_long pending;
+	atomic_int sleeping;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+typedef struct {
+	ThreadPool *pool;
+	int worker;
+} WorkerArgs;
+
+ThreadPool *thread_pool_init(int workers, ThreadTaskFn run, void *ctx) {
+	ThreadPool *pool = (ThreadPool *)calloc(1, sizeof(ThreadPool));
+
+	if (workers < 1) {
+		workers = get_cpu_count();
+	}
+
+	pool->deques = (TaskDeque *)calloc(workers, sizeof(TaskDeque));
+	for (int i = 0; i < workers; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+	}
+	pool->workers = workers;
+	pool->run = run;
+	pool->ctx = ctx;
+	atomic_init(&pool->pending, 0);
+	atomic_init(&pool->sleeping, 0);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+
+	return pool;
+}
+
+static void deque_push(TaskDeque *deque, void *task) {
+	pthread_mutex_lock(&deque->lock);
+	if (deque->tail == deque->capacity) {
+		if (deque->head > 0) {
+			memmove(deque->tasks, deque->tasks + deque->head,
+					sizeof(void *) * (deque->tail - deque->head));
+			deque->tail -= deque->head;
+			deque->head = 0;
+		} else {
+			deque->capacity = deque->capacity ? deque->capacity * 2 : 64;
+			deque->tasks = (void **)realloc(deque->tasks,
+											sizeof(void *) * deque->capacity);
+		}
+	}
+	deque->tasks[deque->tail++] = task;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+static void *deque_take(TaskDeque *deque, bool steal) {
+	void *task = NULL;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->tail > deque->head) {
+		task = steal ? deque->tasks[deque->head++]
+					 : deque->tasks[--deque->tail];
+	}
+	if (deque->tail == deque->head) {
+		deque->head = 0;
+		deque->tail = 0;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return task;
+}
+
+/* The worker's own newest task, or the oldest task of another worker */
+static void *thread_pool_take(ThreadPool *pool, int worker) {
+	void *task = deque_take(&pool->deques[worker], false);
+	for (int i = 1; task == NULL && i < pool->workers; i++) {
+		task = deque_take(&pool->deques[(worker + i) % pool->workers], true);
+	}
+	return task;
+}
+
+/* Can be called before thread_pool_run, as worker 0, or from a running task
+ * with the worker it was given */
+void thread_pool_submit(ThreadPool *pool, int worker, void *task) {
+	atomic_fetch_add(&pool->pending, 1);
+	deque_push(&pool->deques[worker], task);
+
+	/* a worker going to sleep checks the deques again after announcing it,
+	 * so either it sees the task or the signal reaches it */
+	if (atomic_load(&pool->sleeping) > 0) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+static void thread_pool_work(ThreadPool *pool, int worker) {
+	for (;;) {
+		void *task = thread_pool_take(pool, worker);
+		if (task == NULL) {
+			pthread_mutex_lock(&pool->lock);
+			atomic_fetch_add(&pool->sleeping, 1);
+			while ((task = thread_pool_take(pool, worker)) == NULL &&
+				   atomic_load(&pool->pending) > 0) {
+				pthread_cond_wait(&pool->wake, &pool->lock);
+			}
+			atomic_fetch_sub(&pool->sleeping, 1);
+			pthread_mutex_unlock(&pool->lock);
+			if (task == NULL) {
+				return;
+			}
+		}
+
+		pool->run(pool, worker, task, pool->ctx);
+
+		if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+			pthread_mutex_lock(&pool->lock);
+			pthread_cond_broadcast(&pool->wake);
+			pthread_mutex_unlock(&pool->lock);
+		}
+	}
+}
+
+static void *thread_pool_main(void *data) {
+	WorkerArgs *args = (WorkerArgs *)data;
+	thread_pool_work(args->pool, args->worker);
+	return NULL;
+}
+
+/* Runs until every submitted task, and every task they submitted, is done.
+ * Workers that can't be started are simply left out */
+void thread_pool_run(ThreadPool *pool) {
+	pthread_t *threads =
+		(pthread_t *)malloc(sizeof(pthread_t) * pool->workers);
+	WorkerArgs *args = (WorkerArgs *)malloc(sizeof(WorkerArgs) * pool->workers);
+	int started = 1;
+
+	for (int i = 1; i < pool->workers; i++) {
+		args[started].pool = pool;
+		args[started].worker = i;
+		if (pthread_create(&threads[started], NULL, thread_pool_main,
+						   &args[started]) == 0) {
+			started++;
+		}
+	}
+
+	thread_pool_work(pool, 0);
+
+	for (int i = 1; i < started; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(args);
+}
+
+void thread_pool_free(ThreadPool *pool) {
+	for (int i = 0; i < pool->workers; i++) {
+		pthread_mutex_destroy(&pool->deques[i].lock);
+		free(pool->deques[i].tasks);
+	}
+	free(pool->deques);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->wake);
+	free(pool);
+}
@@ -15,32 +15,6 @@ const char *get_filename_without_path(const char *path) {
 	return filename;
 }
 
-Vector *string_split(Arena *arena, String *str, char sep) {
-	Vector *lines = vector_init(String *);
-	char *cstr = string(str);
-	int len = string_len(str);
-	int start = 0;
-
-	for (int i = 0; i < len; i++) {
-		if (cstr[i] == sep) {
-			String *line = string_sub(arena, str, start, i);
-			append(String *, lines, line);
-			start = i + 1;
-		}
-	}
-
-	if (start <= len) {
-		String *line = string_sub(arena, str, start, len);
-		append(String *, lines, line);
-	}
-
-	return lines;
-}
-
-Vector *string_split_lines(Arena *arena, String *str) {
-	return string_split(arena, str, '\n');
-}
-
 int check_project_lang(char *lang) {
 	if (STR_CMP(lang, "c++") == 0 || STR_CMP(lang, "cpp") == 0) {
 		return 0;
@@ -83,20 +57,33 @@ char *get_repo_name(Arena *arena, const char *git_url) {
 	return repo_name;
 }
 
-bool set_contains(Vector *v, char *elem) {
-
-	for (int i = 0; i < length(v); i++) {
-		if (STR_CMP(at(char *, v, i), elem) == 0) {
-			return true;
-		}
+/* Manifest entries compare case-insensitively, like STR_CMP */
+static size_t hash_str_nocase(const char *key) {
+	uint64_t hash = 14695981039346656037ULL;
+	while (*key != '\0') {
+		hash ^= (unsigned char)tolower((unsigned char)*key++);
+		hash *= 1099511628211ULL;
 	}
-	return false;
+	return (size_t)hash;
 }
 
-void set_add(Vector *v, char *elem) {
-	if (!set_contains(v, elem)) {
-		append(char *, v, elem);
-	}
+static int key_eq_nocase(const char *a, const char *b) {
+	size_t len = strlen(a);
+	return strlen(b) == len && scan_casecmp(a, b, len) == 0;
+}
+
+HashSet *string_set_init() {
+	return hashset_init_with(hash_str_nocase, key_eq_nocase);
+}
+
+bool set_contains(HashSet *set, char *elem) {
+	return hashset_contains(set, elem);
+}
+
+void set_add(HashSet *set, char *elem) { hashset_add(set, elem); }
+
+void append_all(Vector *dest, Vector *src) {
+	append_n(dest, at_impl(src, 0), length(src));
 }
 
 int copy_file(const char *src_path, const char *dest_path) {